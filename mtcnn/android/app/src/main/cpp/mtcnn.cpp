@@ -8,6 +8,8 @@
 
 #include "mtcnn.h"
 
+#include <stdio.h>
+#include <string.h>
 #include <android/log.h>
 #define TAG "MtcnnCpp"
 #define LOGD(...) __android_log_print(ANDROID_LOG_DEBUG,TAG,__VA_ARGS__)
@@ -35,6 +37,115 @@ bool cmpArea(Bbox lsh, Bbox rsh) {
 }
 
 
+// num_output (0=), kernel_w (1=), bias_term (5=) and weight_data_size (6=)
+// of the first Convolution of a text param, the one reading the image.
+// Returns false unless it is square (11=), not dilated (2=, 12=) and not
+// padded (4=, 14=, 15=, 16=): padding would add raw zeros to the input, which
+// the folded weights would take for pixels.
+static bool firstConvolution(const string &param_file, int &num_output, int &kernel,
+                             int &bias_term, int &weight_size) {
+    FILE *fp = fopen(param_file.c_str(), "rb");
+    if (!fp)
+        return false;
+    char line[1024];
+    bool found = false;
+    bool plain = true;
+    while (!found && fgets(line, sizeof(line), fp)) {
+        if (strncmp(line, "Convolution", 11) != 0)
+            continue;
+        num_output = kernel = bias_term = weight_size = 0;
+        int kernel_h = -1;
+        for (char *token = strtok(line, " \t\r\n"); token; token = strtok(NULL, " \t\r\n")) {
+            int id, value;
+            if (sscanf(token, "%d=%d", &id, &value) != 2)
+                continue;
+            if (id == 0) num_output = value;
+            if (id == 1) kernel = value;
+            if (id == 5) bias_term = value;
+            if (id == 6) weight_size = value;
+            if (id == 11) kernel_h = value;
+            if ((id == 2 || id == 12) && value != 1) plain = false;
+            if ((id == 4 || id == 14 || id == 15 || id == 16) && value != 0) plain = false;
+        }
+        if (kernel_h != -1 && kernel_h != kernel)
+            plain = false;
+        found = true;
+    }
+    fclose(fp);
+    return found && plain && num_output > 0 && kernel > 0 && bias_term && weight_size > 0;
+}
+
+// Load param_file, and bin_file through weights with (x - mean_vals) * norm_vals
+// of the input folded into its first convolution, so the net takes raw pixels:
+// w' = w * norm, b' = b - sum(w * norm * mean). It has no padding, so borders agree.
+// The weights of that layer come first in bin_file: 4 bytes of flag, 0 for
+// float32, weight_data_size weights, then num_output bias.
+// Returns false if not folded, weights then loaded from bin_file as they are.
+bool MTCNN::loadNet(ncnn::Net &net, const string &param_file, const string &bin_file,
+                    std::vector<float> &weights) {
+    net.load_param(param_file.data());
+    int num_output, kernel, bias_term, weight_size;
+    FILE *fp = fopen(bin_file.c_str(), "rb");
+    if (!fp || !firstConvolution(param_file, num_output, kernel, bias_term, weight_size)) {
+        if (fp)
+            fclose(fp);
+        net.load_model(bin_file.data());
+        return false;
+    }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    // float vector keeps the 4-byte alignment load_model needs
+    weights.resize((size + sizeof(float) - 1) / sizeof(float));
+    bool ok = fread(weights.data(), 1, size, fp) == (size_t)size;
+    fclose(fp);
+    unsigned int flag;
+    memcpy(&flag, weights.data(), sizeof(flag));
+    int channels = weight_size / num_output / (kernel * kernel);
+    if (!ok || flag != 0 || size < (long)(1 + weight_size + num_output) * 4 || channels > 3) {
+        weights.clear();
+        net.load_model(bin_file.data());
+        return false;
+    }
+    float *weight = weights.data() + 1;
+    float *bias = weight + weight_size;
+    int area = kernel * kernel;
+    for (int p = 0; p < num_output; p++) {
+        for (int q = 0; q < channels; q++) {
+            float *w = weight + (p * channels + q) * area;
+            for (int k = 0; k < area; k++) {
+                w[k] *= norm_vals[q];
+                bias[p] -= w[k] * mean_vals[q];
+            }
+        }
+    }
+    net.load_model((const unsigned char *)weights.data());
+    return true;
+}
+
+// Load the three nets with the input folded into all of them or none: the
+// image is normalized once for all nets, so a net folded while another is not
+// is loaded again from its bin_file as it is.
+void MTCNN::loadNets(const std::vector<std::string> &param_files,
+                     const std::vector<std::string> &bin_files) {
+    ncnn::Net *nets[3] = {&Pnet, &Rnet, &Onet};
+    std::vector<float> *weights[3] = {&Pweights, &Rweights, &Oweights};
+    bool folded[3];
+    for (int i = 0; i < 3; i++)
+        folded[i] = loadNet(*nets[i], param_files[i], bin_files[i], *weights[i]);
+    input_folded = folded[0] && folded[1] && folded[2];
+    if (input_folded)
+        return;
+    for (int i = 0; i < 3; i++) {
+        if (!folded[i])
+            continue;
+        nets[i]->clear();
+        nets[i]->load_param(param_files[i].data());
+        nets[i]->load_model(bin_files[i].data());
+        weights[i]->clear();
+    }
+}
+
 //MTCNN::MTCNN(){}
 MTCNN::MTCNN(const string &model_path) {
 
@@ -50,21 +161,11 @@ MTCNN::MTCNN(const string &model_path) {
 		model_path+"/det3.bin"
 	};
 
-    Pnet.load_param(param_files[0].data());
-    Pnet.load_model(bin_files[0].data());
-	Rnet.load_param(param_files[1].data());
-	Rnet.load_model(bin_files[1].data());
-	Onet.load_param(param_files[2].data());
-	Onet.load_model(bin_files[2].data());
+    loadNets(param_files, bin_files);
 }
 
 MTCNN::MTCNN(const std::vector<std::string> param_files, const std::vector<std::string> bin_files){
-    Pnet.load_param(param_files[0].data());
-    Pnet.load_model(bin_files[0].data());
-    Rnet.load_param(param_files[1].data());
-    Rnet.load_model(bin_files[1].data());
-    Onet.load_param(param_files[2].data());
-    Onet.load_model(bin_files[2].data());
+    loadNets(param_files, bin_files);
 }
 
 
@@ -381,7 +482,12 @@ void MTCNN::detect(ncnn::Mat& img_, std::vector<Bbox>& finalBbox_){
     img = img_;
     img_w = img.w;
     img_h = img.h;
-    img.substract_mean_normalize(mean_vals, norm_vals);
+    // raw pixels go into the nets, normalization is folded into their conv1
+    // else a copy is normalized, img_ is the caller's frame
+    if (!input_folded) {
+        img = img_.clone();
+        img.substract_mean_normalize(mean_vals, norm_vals);
+    }
 
 #if(TIMEOPEN==1)
     double total_time = 0.;
@@ -448,7 +554,12 @@ void MTCNN::detectMaxFace(ncnn::Mat& img_, std::vector<Bbox>& finalBbox) {
     img = img_;
     img_w = img.w;
     img_h = img.h;
-    img.substract_mean_normalize(mean_vals, norm_vals);
+    // raw pixels go into the nets, normalization is folded into their conv1
+    // else a copy is normalized, img_ is the caller's frame
+    if (!input_folded) {
+        img = img_.clone();
+        img.substract_mean_normalize(mean_vals, norm_vals);
+    }
 
 #if(TIMEOPEN==1)
     double total_time = 0.;
@@ -55,7 +55,15 @@ private:
 	void PNet();
     void RNet();
     void ONet();
+    bool loadNet(ncnn::Net &net, const string &param_file, const string &bin_file,
+                 std::vector<float> &weights);
+    void loadNets(const std::vector<std::string> &param_files,
+                  const std::vector<std::string> &bin_files);
+    // weights of the nets with mean_vals and norm_vals folded in, used in place
+    std::vector<float> Pweights, Rweights, Oweights;
     ncnn::Net Pnet, Rnet, Onet;
+    // whether all nets take raw pixels, else detect normalizes the image
+    bool input_folded = false;
     ncnn::Mat img;
     const float nms_threshold[3] = {0.5f, 0.7f, 0.7f};
    
@@ -1,6 +1,7 @@
 #include <android/bitmap.h>
 #include <android/log.h>
 #include <jni.h>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -12,10 +13,19 @@ using namespace std;
 #define TAG "MtcnnSo"
 #define LOGD(...) __android_log_print(ANDROID_LOG_DEBUG,TAG,__VA_ARGS__)
 static MTCNN *mtcnn;
+//mtcnn及detection_sdk_init_ok由此锁保护：初始化、释放、设置和检测都需持有。
+//MTCNN的检测状态保存在成员中，检测调用是串行的
+static std::mutex mtcnn_mutex;
 
 //sdk是否初始化成功
 bool detection_sdk_init_ok = false;
 
+//持锁读取初始化状态，检测前仍需在持锁时再次确认
+static bool sdk_init_ok() {
+    std::lock_guard<std::mutex> lock(mtcnn_mutex);
+    return detection_sdk_init_ok;
+}
+
 
 extern "C" {
 
@@ -23,6 +33,7 @@ JNIEXPORT jboolean JNICALL
 Java_com_mtcnn_1as_MTCNN_FaceDetectionModelInit(JNIEnv *env, jobject instance,
                                                 jstring faceDetectionModelPath_) {
      LOGD("JNI开始人脸检测模型初始化");
+    std::lock_guard<std::mutex> lock(mtcnn_mutex);
     //如果已初始化则直接返回
     if (detection_sdk_init_ok) {
         //  LOGD("人脸检测模型已经导入");
@@ -65,7 +76,7 @@ JNIEXPORT jintArray JNICALL
 Java_com_mtcnn_1as_MTCNN_FaceDetect(JNIEnv *env, jobject instance, jbyteArray imageDate_,
                                     jint imageWidth, jint imageHeight, jint imageChannel) {
     //  LOGD("JNI开始检测人脸");
-    if(!detection_sdk_init_ok){
+    if(!sdk_init_ok()){
         LOGD("人脸检测MTCNN模型SDK未初始化，直接返回空");
         return NULL;
     }
@@ -114,7 +125,16 @@ Java_com_mtcnn_1as_MTCNN_FaceDetect(JNIEnv *env, jobject instance, jbyteArray im
     }
 
     std::vector<Bbox> finalBbox;
-    mtcnn->detect(ncnn_img, finalBbox);
+    {
+        std::lock_guard<std::mutex> lock(mtcnn_mutex);
+        //检测前可能已被释放
+        if(!detection_sdk_init_ok){
+            LOGD("人脸检测MTCNN模型SDK已释放，直接返回空");
+            env->ReleaseByteArrayElements(imageDate_, imageDate, 0);
+            return NULL;
+        }
+        mtcnn->detect(ncnn_img, finalBbox);
+    }
 
     int32_t num_face = static_cast<int32_t>(finalBbox.size());
     LOGD("检测到的人脸数目：%d\n", num_face);
@@ -145,7 +165,7 @@ JNIEXPORT jintArray JNICALL
 Java_com_mtcnn_1as_MTCNN_MaxFaceDetect(JNIEnv *env, jobject instance, jbyteArray imageDate_,
                                        jint imageWidth, jint imageHeight, jint imageChannel) {
     //  LOGD("JNI开始检测人脸");
-    if(!detection_sdk_init_ok){
+    if(!sdk_init_ok()){
         LOGD("人脸检测MTCNN模型SDK未初始化，直接返回空");
         return NULL;
     }
@@ -194,7 +214,16 @@ Java_com_mtcnn_1as_MTCNN_MaxFaceDetect(JNIEnv *env, jobject instance, jbyteArray
     }
 
     std::vector<Bbox> finalBbox;
-    mtcnn->detectMaxFace(ncnn_img, finalBbox);
+    {
+        std::lock_guard<std::mutex> lock(mtcnn_mutex);
+        //检测前可能已被释放
+        if(!detection_sdk_init_ok){
+            LOGD("人脸检测MTCNN模型SDK已释放，直接返回空");
+            env->ReleaseByteArrayElements(imageDate_, imageDate, 0);
+            return NULL;
+        }
+        mtcnn->detectMaxFace(ncnn_img, finalBbox);
+    }
 
     int32_t num_face = static_cast<int32_t>(finalBbox.size());
     LOGD("检测到的人脸数目：%d\n", num_face);
@@ -224,12 +253,15 @@ Java_com_mtcnn_1as_MTCNN_MaxFaceDetect(JNIEnv *env, jobject instance, jbyteArray
 
 JNIEXPORT jboolean JNICALL
 Java_com_mtcnn_1as_MTCNN_FaceDetectionModelUnInit(JNIEnv *env, jobject instance) {
+    //等待进行中的检测结束后再释放
+    std::lock_guard<std::mutex> lock(mtcnn_mutex);
     if(!detection_sdk_init_ok){
         LOGD("人脸检测MTCNN模型已经释放过或者未初始化");
         return true;
     }
     jboolean tDetectionUnInit = false;
     delete mtcnn;
+    mtcnn = NULL;
 
 
     detection_sdk_init_ok=false;
@@ -242,6 +274,7 @@ Java_com_mtcnn_1as_MTCNN_FaceDetectionModelUnInit(JNIEnv *env, jobject instance)
 
 JNIEXPORT jboolean JNICALL
 Java_com_mtcnn_1as_MTCNN_SetMinFaceSize(JNIEnv *env, jobject instance, jint minSize) {
+    std::lock_guard<std::mutex> lock(mtcnn_mutex);
     if(!detection_sdk_init_ok){
         LOGD("人脸检测MTCNN模型SDK未初始化，直接返回");
         return false;
@@ -258,6 +291,7 @@ Java_com_mtcnn_1as_MTCNN_SetMinFaceSize(JNIEnv *env, jobject instance, jint minS
 
 JNIEXPORT jboolean JNICALL
 Java_com_mtcnn_1as_MTCNN_SetThreadsNumber(JNIEnv *env, jobject instance, jint threadsNumber) {
+    std::lock_guard<std::mutex> lock(mtcnn_mutex);
     if(!detection_sdk_init_ok){
         LOGD("人脸检测MTCNN模型SDK未初始化，直接返回");
         return false;
@@ -275,7 +309,7 @@ Java_com_mtcnn_1as_MTCNN_SetThreadsNumber(JNIEnv *env, jobject instance, jint th
 
 JNIEXPORT jboolean JNICALL
 Java_com_mtcnn_1as_MTCNN_SetTimeCount(JNIEnv *env, jobject instance, jint timeCount) {
-
+    std::lock_guard<std::mutex> lock(mtcnn_mutex);
     if(!detection_sdk_init_ok){
         LOGD("人脸检测MTCNN模型SDK未初始化，直接返回");
         return false;
@@ -0,0 +1,24 @@
+# Embed model files into a header, one 4-byte aligned array per file named
+# after it with '.' as '_', e.g. det1.param.bin -> det1_param_bin, so ncnn
+# Net::load_param/load_model(const unsigned char*) use them in place. Each
+# ends with a 0, so text params are strings for Net::load_param_mem.
+# usage: embed_models(<header> <file>...)
+function(embed_models header)
+  set(content "// generated from models by embed_models.cmake, do not edit\n")
+  set(content "${content}#ifndef MTCNN_MODELS_MEM_H_\n#define MTCNN_MODELS_MEM_H_\n\n")
+  foreach(file ${ARGN})
+    get_filename_component(name ${file} NAME)
+    string(REPLACE "." "_" name ${name})
+    file(READ ${file} bytes HEX)
+    # 16 bytes a line
+    string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," bytes "${bytes}")
+    set(line "")
+    foreach(i RANGE 15)
+      set(line "${line}0x..,")
+    endforeach()
+    string(REGEX REPLACE "(${line})" "\\1\n" bytes "${bytes}")
+    set(content "${content}alignas(4) static const unsigned char ${name}[] = {\n${bytes}0x00\n};\n\n")
+  endforeach()
+  set(content "${content}#endif // MTCNN_MODELS_MEM_H_\n")
+  file(WRITE ${header} "${content}")
+endfunction()
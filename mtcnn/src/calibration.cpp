@@ -0,0 +1,241 @@
+#include <algorithm>  // std::max
+#include <cfloat>     // DBL_MAX
+#include <cmath>
+#include <set>
+
+#include "calibration.h"
+using namespace std;
+using namespace face;
+
+// bins of input histograms, and int8 levels of a sign
+static const int kHistogramBins = 2048;
+static const int kLevels = 128;
+
+// Tag of int8 weights in a .bin, see ncnn ModelBin.
+static const unsigned int kInt8Tag = 0x000D4B38;
+
+int Int8Calibrator::Load(const string & model_dir, const string & name)
+{
+  if (model.Load(model_dir, name) != 0)
+    return -1;
+  size_t n = model.layers.size();
+  quantized.assign(n, false);
+  inputs.assign(n, Histogram());
+  for (size_t i = 0; i < n; i++) {
+    const ModelFile::Layer & layer = model.layers[i];
+    quantized[i] = (layer.type == "Convolution" || layer.type == "InnerProduct") &&
+      model.Hidden(layer);
+  }
+  net.clear();
+  string path = model_dir + "/" + name;
+  if (net.load_param((path + ".param").c_str()) != 0 ||
+    net.load_model((path + ".bin").c_str()) != 0)
+    return -1;
+  return 0;
+}
+
+void Int8Calibrator::Histogram::Add(const ncnn::Mat & blob)
+{
+  if (bins.empty())
+    bins.assign(kHistogramBins, 0);
+  float max_value = 0;
+  for (int q = 0; q < blob.c; q++) {
+    const float* ptr = blob.channel(q);
+    for (int i = 0; i < blob.w * blob.h; i++)
+      max_value = std::max(max_value, fabsf(ptr[i]));
+  }
+  if (max_value == 0)
+    return;
+  if (range == 0)
+    range = max_value;
+  while (max_value > range) {
+    for (int i = 0; i < kHistogramBins / 2; i++)
+      bins[i] = bins[2 * i] + bins[2 * i + 1];
+    std::fill(bins.begin() + kHistogramBins / 2, bins.end(), 0.0);
+    range *= 2;
+  }
+  float bin_scale = kHistogramBins / range;
+  for (int q = 0; q < blob.c; q++) {
+    const float* ptr = blob.channel(q);
+    for (int i = 0; i < blob.w * blob.h; i++) {
+      // zeros, e.g. of padding, say nothing of the range
+      if (ptr[i] == 0)
+        continue;
+      int bin = static_cast<int>(fabsf(ptr[i]) * bin_scale);
+      bins[std::min(bin, kHistogramBins - 1)]++;
+    }
+  }
+}
+
+void Int8Calibrator::Add(const ncnn::Mat & data)
+{
+  ncnn::Extractor ex = net.create_extractor();
+  ex.set_light_mode(false);
+  ex.input("data", data);
+  for (size_t i = 0; i < model.layers.size(); i++) {
+    if (!quantized[i])
+      continue;
+    ncnn::Mat blob;
+    ex.extract(model.layers[i].bottoms[0].c_str(), blob);
+    inputs[i].Add(blob);
+  }
+}
+
+// KL divergence of q from p, both normalized here.
+static double KLDivergence(const vector<double> & p, const vector<double> & q)
+{
+  double p_sum = 0, q_sum = 0;
+  for (size_t i = 0; i < p.size(); i++) {
+    p_sum += p[i];
+    q_sum += q[i];
+  }
+  double kl = 0;
+  for (size_t i = 0; i < p.size(); i++) {
+    if (p[i] == 0)
+      continue;
+    double pi = p[i] / p_sum;
+    // outliers clipped into a bin q left empty
+    double qi = q[i] > 0 ? q[i] / q_sum : 1e-12;
+    kl += pi * log(pi / qi);
+  }
+  return kl;
+}
+
+int Int8Calibrator::KLThreshold(const vector<double> & histogram)
+{
+  int bins = static_cast<int>(histogram.size());
+  int best = bins;
+  double min_kl = DBL_MAX;
+  vector<double> clipped, levels(kLevels), expanded;
+  for (int threshold = kLevels; threshold <= bins; threshold++) {
+    // reference: bins up to threshold, the ones beyond added to the last
+    clipped.assign(histogram.begin(), histogram.begin() + threshold);
+    for (int i = threshold; i < bins; i++)
+      clipped[threshold - 1] += histogram[i];
+    // the same bins in 128 levels, each level spread back evenly over its
+    // nonempty bins, bins shared by two levels split by their overlap
+    double bins_per_level = static_cast<double>(threshold) / kLevels;
+    std::fill(levels.begin(), levels.end(), 0.0);
+    expanded.assign(threshold, 0);
+    for (int l = 0; l < kLevels; l++) {
+      double start = l * bins_per_level, end = start + bins_per_level;
+      int left = static_cast<int>(ceil(start)), right = static_cast<int>(floor(end));
+      double left_part = left - start, right_part = right < threshold ? end - right : 0;
+      double count = 0;
+      if (left_part > 0) {
+        levels[l] += left_part * histogram[left - 1];
+        count += histogram[left - 1] != 0 ? left_part : 0;
+      }
+      if (right_part > 0) {
+        levels[l] += right_part * histogram[right];
+        count += histogram[right] != 0 ? right_part : 0;
+      }
+      for (int i = left; i < right; i++) {
+        levels[l] += histogram[i];
+        count += histogram[i] != 0 ? 1 : 0;
+      }
+      if (count == 0)
+        continue;
+      double value = levels[l] / count;
+      if (left_part > 0 && histogram[left - 1] != 0)
+        expanded[left - 1] += value * left_part;
+      if (right_part > 0 && histogram[right] != 0)
+        expanded[right] += value * right_part;
+      for (int i = left; i < right; i++) {
+        if (histogram[i] != 0)
+          expanded[i] += value;
+      }
+    }
+    double kl = KLDivergence(clipped, expanded);
+    if (kl < min_kl) {
+      min_kl = kl;
+      best = threshold;
+    }
+  }
+  return best;
+}
+
+int Int8Calibrator::Save(const string & out_dir, const vector<string> & params) const
+{
+  // layers some param runs as a float custom layer, e.g. ConvPReLU of
+  // det1_head, keep float weights in the shared .bin
+  set<string> float_names;
+  for (const string & param : params) {
+    vector<string> lines;
+    if (!ModelFile::ReadParam(model.model_dir + "/" + param, lines))
+      return -1;
+    for (size_t i = 2; i < lines.size(); i++) {
+      ModelFile::Layer layer;
+      if (ModelFile::ParseLine(lines[i], layer) &&
+        layer.type != "Convolution" && layer.type != "InnerProduct")
+        float_names.insert(layer.name);
+    }
+  }
+  vector<bool> quantize = quantized;
+  set<string> names;
+  for (size_t i = 0; i < model.layers.size(); i++) {
+    if (float_names.count(model.layers[i].name))
+      quantize[i] = false;
+    if (quantize[i])
+      names.insert(model.layers[i].name);
+  }
+  // batch params run fc layers as Convolution, with the same weights
+  int ret = ModelFile::CopyParams(model.model_dir, out_dir, params,
+    [&names](const ModelFile::Layer & layer, string & line) {
+      if (names.count(layer.name) &&
+        (layer.type == "Convolution" || layer.type == "InnerProduct"))
+        line += " 8=1";
+    });
+  if (ret != 0)
+    return -1;
+
+  FILE* fp = fopen((out_dir + "/" + model.name + ".bin").c_str(), "wb");
+  if (!fp)
+    return -1;
+  for (size_t l = 0; l < model.layers.size(); l++) {
+    const ModelFile::Layer & layer = model.layers[l];
+    if (!layer.slopes.empty())
+      ModelFile::WriteFloats(fp, layer.slopes);
+    if (layer.weights.empty())
+      continue;
+    if (!quantize[l]) {
+      unsigned int flag = 0;
+      fwrite(&flag, sizeof(flag), 1, fp);
+      ModelFile::WriteFloats(fp, layer.weights);
+      if (layer.bias)
+        ModelFile::WriteFloats(fp, layer.bias_data);
+      continue;
+    }
+    // weights of output channel p scaled so their largest is 127
+    int n = static_cast<int>(layer.weights.size());
+    int size = n / layer.num_output;
+    vector<float> scales(layer.num_output);
+    vector<signed char> weights(n + (4 - n % 4) % 4, 0);
+    for (int p = 0; p < layer.num_output; p++) {
+      float max_weight = 0;
+      for (int i = 0; i < size; i++)
+        max_weight = std::max(max_weight, fabsf(layer.weights[p * size + i]));
+      scales[p] = max_weight > 0 ? 127 / max_weight : 1;
+      for (int i = 0; i < size; i++) {
+        float q = roundf(layer.weights[p * size + i] * scales[p]);
+        weights[p * size + i] = static_cast<signed char>(std::max(-127.f, std::min(127.f, q)));
+      }
+    }
+    fwrite(&kInt8Tag, sizeof(kInt8Tag), 1, fp);
+    fwrite(weights.data(), 1, weights.size(), fp);
+    if (layer.bias)
+      ModelFile::WriteFloats(fp, layer.bias_data);
+    ModelFile::WriteFloats(fp, scales);
+    // input clipped at the KL threshold, the middle of its bin
+    const Histogram & input = inputs[l];
+    float input_scale = 1;
+    if (input.range > 0) {
+      int threshold = KLThreshold(input.bins);
+      input_scale = 127 / ((threshold + 0.5f) * input.range / kHistogramBins);
+    }
+    ModelFile::WriteFloats(fp, vector<float>(1, input_scale));
+  }
+  bool ok = ferror(fp) == 0;
+  fclose(fp);
+  return ok ? 0 : -1;
+}
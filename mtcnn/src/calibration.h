@@ -0,0 +1,63 @@
+#ifndef FACE_CALIBRATION_H_
+#define FACE_CALIBRATION_H_
+
+#include <string>
+#include <vector>
+// ncnn
+#include "net.h"
+#include "model_file.h"
+
+namespace face
+{
+// Int8 quantization of a float MTCNN model for ncnn int8 inference.
+// Hidden Convolution and InnerProduct layers, those whose output goes into
+// PReLU, are quantized. Heads giving scores, offsets and landmarks stay
+// float: they are small, their outputs are compared against thresholds,
+// and PnetHead reads the float weights of the Pnet ones.
+// Weights get one scale per output channel from their largest magnitude.
+// The input blob of a layer gets one scale from the histogram of its values
+// over calibration inputs, clipped where the KL divergence between the
+// clipped and the int8 histograms is smallest.
+// Quantized layers get int8_scale_term (8=1) in the .param, and in the .bin
+// int8 weights, then float bias, weight scales and input scale, as ncnn
+// Convolution and InnerProduct load them.
+class Int8Calibrator
+{
+public:
+  /// @brief Load float model model_dir/name.param and name.bin.
+  /// @return 0 on success, -1 if files are missing or hold layers with
+  /// weights other than Convolution, InnerProduct and PReLU.
+  int Load(const std::string & model_dir, const std::string & name);
+  /// @brief Run net on one calibration input, blob "data", and collect
+  /// values of the inputs of quantized layers.
+  void Add(const ncnn::Mat & data);
+  /// @brief Write int8 name.bin into out_dir, with params of model_dir
+  /// sharing that .bin, e.g. det1.param and det1_head.param, their layers
+  /// quantized by name. Layers a param runs as a custom layer, as
+  /// ConvPReLU, stay float.
+  /// @return 0 on success, -1 if a file can't be read or written.
+  int Save(const std::string & out_dir, const std::vector<std::string> & params) const;
+
+  /// @brief Threshold of 128 int8 levels with the smallest KL divergence to
+  /// histogram, in bins: values from bins up to it keep their shape, those
+  /// beyond are clipped to it.
+  static int KLThreshold(const std::vector<double> & histogram);
+
+private:
+  // |values| of a blob in bins over [0, range), range doubles as larger
+  // values come, merging bins in pairs.
+  struct Histogram {
+    float range = 0;
+    std::vector<double> bins;
+    void Add(const ncnn::Mat & blob);
+  };
+
+  ModelFile model;
+  ncnn::Net net;
+  std::vector<bool> quantized;     // of each layer of model
+  std::vector<Histogram> inputs;   // of quantized layers
+};
+
+} // namespace face
+
+#endif // FACE_CALIBRATION_H_
@@ -0,0 +1,99 @@
+#include <algorithm>  // std::max, std::min
+#include <vector>
+
+#include "conv3x3.h"
+using namespace std;
+using namespace face;
+
+ncnn::Mat face::PackConv3x3(const ncnn::Mat & weights, int num_output, int channels)
+{
+  int blocks = (num_output + kConv3x3Block - 1) / kConv3x3Block;
+  ncnn::Mat packed(blocks * channels * 9 * kConv3x3Block);
+  if (packed.empty())
+    return packed;
+  packed.fill(0.f);
+  const float* src = weights;
+  float* dst = packed;
+  for (int p = 0; p < num_output; p++) {
+    int b = p / kConv3x3Block, i = p % kConv3x3Block;
+    for (int q = 0; q < channels; q++) {
+      for (int k = 0; k < 9; k++)
+        dst[((b * channels + q) * 9 + k) * kConv3x3Block + i] = src[(p * channels + q) * 9 + k];
+    }
+  }
+  return packed;
+}
+
+int face::ConvPReLU3x3(const ncnn::Mat & bottom, ncnn::Mat & top, const ncnn::Mat & packed,
+  const float* bias, const float* slopes, int num_slope, int num_output, bool pool,
+  ncnn::Allocator* blob_allocator, ncnn::Allocator* workspace_allocator)
+{
+  int w = bottom.w;
+  int h = bottom.h;
+  int channels = bottom.c;
+  int outw = w - 2;
+  int outh = h - 2;
+  if (outw <= 0 || outh <= 0)
+    return -1;
+  int topw = pool ? (outw + 1) / 2 : outw;
+  int toph = pool ? (outh + 1) / 2 : outh;
+  top.create(topw, toph, num_output, 4u, blob_allocator);
+  if (top.empty())
+    return -100;
+  // with pool, two convolution rows of the block before pooling
+  ncnn::Mat rows;
+  if (pool) {
+    rows.create(outw, 2, kConv3x3Block, 4u, workspace_allocator);
+    if (rows.empty())
+      return -100;
+  }
+  // rows of the padded tail outputs go to a scratch row
+  ncnn::Mat scratch(outw, 4u, workspace_allocator);
+  if (scratch.empty())
+    return -100;
+
+  const Kernels & kernels = GetKernels();
+  vector<const float*> in(channels);
+  int blocks = (num_output + kConv3x3Block - 1) / kConv3x3Block;
+  for (int b = 0; b < blocks; b++) {
+    int p0 = b * kConv3x3Block;
+    int count = std::min(kConv3x3Block, num_output - p0);
+    const float* kernel = (const float*)packed + b * channels * 9 * kConv3x3Block;
+    float block_bias[kConv3x3Block] = {0}, block_slope[kConv3x3Block] = {0};
+    for (int i = 0; i < count; i++) {
+      block_bias[i] = bias ? bias[p0 + i] : 0.f;
+      block_slope[i] = slopes[num_slope > 1 ? p0 + i : 0];
+    }
+    for (int y = 0; y < toph; y++) {
+      float* out[kConv3x3Block];
+      if (!pool) {
+        for (int i = 0; i < kConv3x3Block; i++)
+          out[i] = i < count ? top.channel(p0 + i).row(y) : (float*)scratch;
+        for (int q = 0; q < channels; q++)
+          in[q] = bottom.channel(q).row(y);
+        kernels.conv3x3_row(in.data(), channels, w, outw, kernel, block_bias, block_slope, out);
+        continue;
+      }
+      // rows 2y and 2y + 1, the second alone past the end, then the max
+      int n = std::min(2, outh - 2 * y);
+      for (int r = 0; r < n; r++) {
+        for (int i = 0; i < kConv3x3Block; i++)
+          out[i] = rows.channel(i).row(r);
+        for (int q = 0; q < channels; q++)
+          in[q] = bottom.channel(q).row(2 * y + r);
+        kernels.conv3x3_row(in.data(), channels, w, outw, kernel, block_bias, block_slope, out);
+      }
+      for (int i = 0; i < count; i++) {
+        float* r0 = rows.channel(i).row(0);
+        const float* r1 = n > 1 ? rows.channel(i).row(1) : r0;
+        kernels.max_rows(r0, r1, outw);
+        float* outptr = top.channel(p0 + i).row(y);
+        for (int j = 0; j < topw; j++) {
+          int x0 = 2 * j;
+          outptr[j] = x0 + 1 < outw ? std::max(r0[x0], r0[x0 + 1]) : r0[x0];
+        }
+      }
+    }
+  }
+  return 0;
+}
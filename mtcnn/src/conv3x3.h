@@ -0,0 +1,34 @@
+#ifndef FACE_CONV3X3_H_
+#define FACE_CONV3X3_H_
+
+// ncnn
+#include "mat.h"
+
+#include "kernels.h"
+
+namespace face
+{
+// Kernels of the Pnet convolutions: 3x3, stride 1, no padding, with few
+// channels (3->10, 10->16, 16->32) over large pyramid levels. Output
+// channels are computed kConv3x3Block at a time, each input row loaded
+// once for all of them, and PReLU applied before the sums leave registers.
+// Rows are computed by the kernels of GetKernels.
+
+/// @brief Weights of a Convolution, num_output x channels x 3 x 3, packed
+/// as the kernels read them: blocks of kConv3x3Block outputs, the tail
+/// block padded with zeros, each [channel][3x3][output in block].
+ncnn::Mat PackConv3x3(const ncnn::Mat & weights, int num_output, int channels);
+
+/// @brief PReLU of the convolution of bottom into top. With pool, the
+/// result is max pooled 2x2 with stride 2 as ncnn Pooling does, the last
+/// row and column alone on odd sizes, without writing it in full.
+/// @param packed: weights from PackConv3x3.
+/// @param slopes: num_output slopes, or 1 shared.
+/// @return 0 on success, -100 if top can't be allocated.
+int ConvPReLU3x3(const ncnn::Mat & bottom, ncnn::Mat & top, const ncnn::Mat & packed,
+  const float* bias, const float* slopes, int num_slope, int num_output, bool pool,
+  ncnn::Allocator* blob_allocator, ncnn::Allocator* workspace_allocator);
+
+} // namespace face
+
+#endif // FACE_CONV3X3_H_
@@ -0,0 +1,79 @@
+#include "frame_allocator.h"
+using namespace std;
+using namespace face;
+
+// Every block starts with a header holding its bucket,
+// kept MALLOC_ALIGN bytes long so data stays aligned.
+static const int kHeader = MALLOC_ALIGN;
+static const int kMinBucket = 6;  // 64 bytes
+static const int kBuckets = 48;
+
+FrameAllocator::FrameAllocator() :
+  buckets(kBuckets)
+{
+}
+
+FrameAllocator::~FrameAllocator()
+{
+  clear();
+}
+
+void* FrameAllocator::fastMalloc(size_t size)
+{
+  int bucket = kMinBucket;
+  while ((size_t(1) << bucket) < size)
+    bucket++;
+  unsigned char* block = 0;
+  {
+    lock_guard<mutex> lock(buckets_mutex);
+    counters.allocs++;
+    counters.bytes += size;
+    if (!buckets[bucket].empty()) {
+      block = static_cast<unsigned char*>(buckets[bucket].back());
+      buckets[bucket].pop_back();
+    }
+    else {
+      counters.heap_allocs++;
+      counters.heap_bytes += size_t(1) << bucket;
+    }
+  }
+  if (!block) {
+    block = static_cast<unsigned char*>(ncnn::fastMalloc(kHeader + (size_t(1) << bucket)));
+    if (!block)
+      return 0;
+    *reinterpret_cast<int*>(block) = bucket;
+  }
+  return block + kHeader;
+}
+
+void FrameAllocator::fastFree(void* ptr)
+{
+  if (!ptr)
+    return;
+  unsigned char* block = static_cast<unsigned char*>(ptr) - kHeader;
+  int bucket = *reinterpret_cast<int*>(block);
+  lock_guard<mutex> lock(buckets_mutex);
+  buckets[bucket].push_back(block);
+}
+
+void FrameAllocator::clear()
+{
+  lock_guard<mutex> lock(buckets_mutex);
+  for (auto & blocks : buckets) {
+    for (void* block : blocks)
+      ncnn::fastFree(block);
+    blocks.clear();
+  }
+}
+
+FrameAllocator::Stats FrameAllocator::stats()
+{
+  lock_guard<mutex> lock(buckets_mutex);
+  return counters;
+}
+
+void FrameAllocator::ResetStats()
+{
+  lock_guard<mutex> lock(buckets_mutex);
+  counters = Stats();
+}
@@ -0,0 +1,44 @@
+#ifndef FACE_FRAME_ALLOCATOR_H_
+#define FACE_FRAME_ALLOCATOR_H_
+
+#include <mutex>
+#include <vector>
+// ncnn
+#include "allocator.h"
+
+namespace face
+{
+// Pool allocator for temporaries of a detector call: extractor blobs,
+// workspace and the detector's own inputs and crops. Freed blocks are kept
+// in power-of-two buckets and handed out again, so once a stream has warmed
+// up, calls no longer go to the heap. Thread safe.
+class FrameAllocator : public ncnn::Allocator
+{
+public:
+  // Counters of requests, and of those the pool had to take from heap.
+  struct Stats {
+    size_t allocs = 0;
+    size_t bytes = 0;
+    size_t heap_allocs = 0;
+    size_t heap_bytes = 0;
+  };
+
+  FrameAllocator();
+  ~FrameAllocator();
+  virtual void* fastMalloc(size_t size);
+  virtual void fastFree(void* ptr);
+  /// @brief Give idle blocks back to heap.
+  void clear();
+  /// @brief Counters since last ResetStats.
+  Stats stats();
+  void ResetStats();
+
+private:
+  std::mutex buckets_mutex;
+  std::vector<std::vector<void*>> buckets;  // idle blocks of 2^i bytes
+  Stats counters;
+};
+
+} // namespace face
+
+#endif // FACE_FRAME_ALLOCATOR_H_
@@ -0,0 +1,75 @@
+#include <cstdio>
+#include <set>
+#include <sstream>
+
+#include "half.h"
+#include "model_file.h"
+using namespace std;
+using namespace face;
+
+// Tag of float16 weights in a .bin, see ncnn ModelBin.
+static const unsigned int kHalfTag = 0x01306B47;
+
+// Line of a HalfInnerProduct running layer, columns as ncnn writes them.
+static string HalfLine(const ModelFile::Layer & layer, int size, bool per_position)
+{
+  char head[64];
+  snprintf(head, sizeof(head), "%-16s %-16s %d %d", "HalfInnerProduct",
+    layer.name.c_str(), (int)layer.bottoms.size(), (int)layer.tops.size());
+  ostringstream line;
+  line << head;
+  for (const string & bottom : layer.bottoms)
+    line << " " << bottom;
+  for (const string & top : layer.tops)
+    line << " " << top;
+  line << " 0=" << layer.num_output << " 1=" << (layer.bias ? 1 : 0) << " 2=" << size;
+  if (per_position)
+    line << " 3=1";
+  return line.str();
+}
+
+int face::SaveHalfModel(const string & model_dir, const string & name,
+  const vector<string> & params, const string & out_dir, bool keep_half)
+{
+  ModelFile model;
+  if (model.Load(model_dir, name) != 0)
+    return -1;
+  set<string> fc;
+  for (const ModelFile::Layer & layer : model.layers) {
+    if (keep_half && layer.type == "InnerProduct")
+      fc.insert(layer.name);
+  }
+  // batch params run fc layers as 1x1 Convolution over tiles
+  int ret = ModelFile::CopyParams(model_dir, out_dir, params,
+    [&fc](const ModelFile::Layer & layer, string & line) {
+      if (!fc.count(layer.name))
+        return;
+      if (layer.type == "InnerProduct")
+        line = HalfLine(layer, layer.params.at(2), false);
+      else if (layer.type == "Convolution")
+        line = HalfLine(layer, layer.params.at(6), true);
+    });
+  if (ret != 0)
+    return -1;
+
+  FILE* fp = fopen((out_dir + "/" + name + ".bin").c_str(), "wb");
+  if (!fp)
+    return -1;
+  for (const ModelFile::Layer & layer : model.layers) {
+    if (!layer.slopes.empty())
+      ModelFile::WriteFloats(fp, layer.slopes);
+    if (layer.weights.empty())
+      continue;
+    // padded to 4 bytes
+    vector<unsigned short> weights((layer.weights.size() + 1) / 2 * 2, 0);
+    for (size_t i = 0; i < layer.weights.size(); i++)
+      weights[i] = HalfFromFloat(layer.weights[i]);
+    fwrite(&kHalfTag, sizeof(kHalfTag), 1, fp);
+    fwrite(weights.data(), sizeof(unsigned short), weights.size(), fp);
+    if (layer.bias)
+      ModelFile::WriteFloats(fp, layer.bias_data);
+  }
+  bool ok = ferror(fp) == 0;
+  fclose(fp);
+  return ok ? 0 : -1;
+}
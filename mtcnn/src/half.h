@@ -0,0 +1,70 @@
+#ifndef FACE_HALF_H_
+#define FACE_HALF_H_
+
+#include <cstring>  // memcpy
+#include <string>
+#include <vector>
+
+namespace face
+{
+/// @brief IEEE float16 of f, rounded to nearest even, inf and nan kept.
+inline unsigned short HalfFromFloat(float f)
+{
+  unsigned int u;
+  memcpy(&u, &f, sizeof(u));
+  unsigned int sign = (u >> 16) & 0x8000;
+  u &= 0x7fffffff;
+  unsigned short h;
+  if (u >= 0x47800000) {
+    // too large for float16, or inf or nan
+    h = u > 0x7f800000 ? 0x7e00 : 0x7c00;
+  } else if (u < 0x38800000) {
+    // subnormal or 0: adding 0.5 lets the float add round the mantissa
+    float v;
+    memcpy(&v, &u, sizeof(v));
+    v += 0.5f;
+    memcpy(&u, &v, sizeof(u));
+    h = static_cast<unsigned short>(u - 0x3f000000);
+  } else {
+    unsigned int odd = (u >> 13) & 1;
+    u += 0xc8000fff + odd;  // rebias exponent 127 to 15, round
+    h = static_cast<unsigned short>(u >> 13);
+  }
+  return static_cast<unsigned short>(h | sign);
+}
+
+/// @brief Float of IEEE float16 h.
+inline float FloatFromHalf(unsigned short h)
+{
+  unsigned int u = (h & 0x7fffu) << 13;  // exponent and mantissa
+  unsigned int exponent = u & 0x0f800000;
+  u += 0x38000000;  // rebias exponent 15 to 127
+  float f;
+  if (exponent == 0x0f800000) {
+    u += 0x38000000;  // inf or nan
+    memcpy(&f, &u, sizeof(f));
+  } else if (exponent == 0) {
+    // subnormal or 0, renormalized by the float subtract
+    u += 0x00800000;
+    memcpy(&f, &u, sizeof(f));
+    f -= 6.10351562e-05f;  // 2^-14
+  } else {
+    memcpy(&f, &u, sizeof(f));
+  }
+  return (h & 0x8000) ? -f : f;
+}
+
+/// @brief Write model_dir/name.bin into out_dir with Convolution and
+/// InnerProduct weights stored as float16, which ncnn expands to float at
+/// load, halving the file. Bias and PReLU slopes stay float. params of
+/// model_dir sharing that .bin are copied along.
+/// @param keep_half: InnerProduct layers, and the Convolution layers of
+/// batch params running them, become HalfInnerProduct, which keeps its
+/// weights as float16 in memory as well.
+/// @return 0 on success, -1 if a file can't be read or written.
+int SaveHalfModel(const std::string & model_dir, const std::string & name,
+  const std::vector<std::string> & params, const std::string & out_dir, bool keep_half);
+
+} // namespace face
+
+#endif // FACE_HALF_H_
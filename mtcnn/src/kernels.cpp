@@ -0,0 +1,123 @@
+#include <cstdlib>  // getenv
+#include <cstring>  // strcmp
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define KERNELS_CPUID 1
+#include <intrin.h>
+#include <immintrin.h>  // _xgetbv
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KERNELS_CPUID 1
+#include <cpuid.h>
+#endif
+
+#include "kernels.h"
+using namespace std;
+using namespace face;
+
+#if KERNELS_CPUID
+// eax, ebx, ecx, edx of CPUID leaf, subleaf.
+static void Cpuid(unsigned leaf, unsigned subleaf, unsigned regs[4])
+{
+#if defined(_MSC_VER)
+  int r[4];
+  __cpuidex(r, static_cast<int>(leaf), static_cast<int>(subleaf));
+  for (int i = 0; i < 4; i++)
+    regs[i] = static_cast<unsigned>(r[i]);
+#else
+  __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+// Register states the OS saves on context switches, XCR0.
+static unsigned long long SavedStates()
+{
+#if defined(_MSC_VER)
+  return _xgetbv(0);
+#else
+  unsigned lo, hi;
+  __asm__ __volatile__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+  return (static_cast<unsigned long long>(hi) << 32) | lo;
+#endif
+}
+#endif
+
+const char* face::IsaName(Isa isa)
+{
+  static const char* const names[ISA_COUNT] = { "baseline", "SSE4.2", "AVX2", "AVX-512" };
+  return isa >= 0 && isa < ISA_COUNT ? names[isa] : "unknown";
+}
+
+Isa face::CpuIsa()
+{
+#if KERNELS_CPUID
+  unsigned regs[4];
+  Cpuid(0, 0, regs);
+  unsigned max_leaf = regs[0];
+  if (max_leaf < 1)
+    return ISA_BASELINE;
+  Cpuid(1, 0, regs);
+  bool sse42 = (regs[2] >> 20) & 1;
+  bool fma = (regs[2] >> 12) & 1;
+  bool osxsave = (regs[2] >> 27) & 1;
+  bool avx = (regs[2] >> 28) & 1;
+  if (!sse42)
+    return ISA_BASELINE;
+  // AVX needs the OS to save xmm and ymm, AVX-512 opmask and zmm as well
+  if (!osxsave || !avx || !fma || max_leaf < 7)
+    return ISA_SSE42;
+  unsigned long long states = SavedStates();
+  if ((states & 0x6) != 0x6)
+    return ISA_SSE42;
+  Cpuid(7, 0, regs);
+  bool avx2 = (regs[1] >> 5) & 1;
+  bool avx512f = (regs[1] >> 16) & 1;
+  if (!avx2)
+    return ISA_SSE42;
+  if (avx512f && (states & 0xe6) == 0xe6)
+    return ISA_AVX512;
+  return ISA_AVX2;
+#else
+  return ISA_BASELINE;
+#endif
+}
+
+const Kernels* face::KernelsFor(Isa isa)
+{
+  switch (isa) {
+  case ISA_BASELINE:
+    return baseline::IsaKernels();
+  case ISA_SSE42:
+    return sse42::IsaKernels();
+  case ISA_AVX2:
+    return avx2::IsaKernels();
+  case ISA_AVX512:
+    return avx512::IsaKernels();
+  default:
+    return nullptr;
+  }
+}
+
+static const Kernels & SelectKernels()
+{
+  int isa = CpuIsa();
+  const char* cap = getenv("MTCNN_ISA");
+  if (cap) {
+    for (int i = ISA_BASELINE; i < isa; i++) {
+      if (strcmp(cap, IsaName(static_cast<Isa>(i))) == 0)
+        isa = i;
+    }
+  }
+  // variants the build lacks fall back to the next narrower one
+  for (; isa > ISA_BASELINE; isa--) {
+    const Kernels* kernels = KernelsFor(static_cast<Isa>(isa));
+    if (kernels)
+      return *kernels;
+  }
+  return *baseline::IsaKernels();
+}
+
+const Kernels & face::GetKernels()
+{
+  static const Kernels & kernels = SelectKernels();
+  return kernels;
+}
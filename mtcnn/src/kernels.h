@@ -0,0 +1,88 @@
+#ifndef FACE_KERNELS_H_
+#define FACE_KERNELS_H_
+
+#include <cstddef>  // size_t
+#include <cstdint>  // uint64_t
+
+namespace face
+{
+// Instruction sets the detector kernels are built for, each a superset of
+// the one before. ISA_BASELINE is what the target always has: SSE2 on x86,
+// NEON on aarch64, plain floats elsewhere.
+enum Isa {
+  ISA_BASELINE,
+  ISA_SSE42,
+  ISA_AVX2,    // with FMA
+  ISA_AVX512,  // AVX-512F
+  ISA_COUNT
+};
+
+// Arrays the kernels read in whole vectors are padded to a multiple of
+// this, the widest vector of floats.
+const int kKernelPad = 16;
+
+// Output channels a 3x3 convolution kernel computes at once, see conv3x3.h.
+const int kConv3x3Block = 4;
+
+// Hot loops of the detector, built once per instruction set from
+// kernels_impl.h and picked at startup by GetKernels. Each behaves the same
+// in every variant, up to the rounding of fused multiply adds in conv3x3_row
+// and logits2.
+struct Kernels {
+  Isa isa;
+  const char* name;  // e.g. "AVX2"
+  int width;         // floats of a vector
+
+  /// @brief One output row of 3x3 convolutions of kConv3x3Block outputs
+  /// with their PReLU, see conv3x3.h. in points at the first input row of
+  /// each channel, rows w floats apart, out at the row of each output.
+  void (*conv3x3_row)(const float* const* in, int channels, int w, int outw,
+    const float* kernel, const float* bias, const float* slope, float* const* out);
+  /// @brief r0[x] = max(r0[x], r1[x]) for x < w.
+  void (*max_rows)(float* r0, const float* r1, int w);
+
+  /// @brief Mark in suppressed the boxes after i overlapping box i by more
+  /// than threshold, see NmsBoxes. Boxes up to n are padded with empty ones
+  /// to a multiple of kKernelPad, bits of boxes up to i may be set too.
+  void (*suppress_all)(const int* x1, const int* y1, const int* x2, const int* y2,
+    const int* areas, int i, int n, float threshold, bool min_overlap, uint64_t* suppressed);
+
+  /// @brief 1x1 convolution of size cells of channels planes, cstep apart,
+  /// into 2 outputs: l0 = b0 + sum of bottom * w0, l1 likewise.
+  void (*logits2)(const float* bottom, size_t cstep, int channels, int size,
+    const float* w0, const float* w1, float b0, float b1, float* l0, float* l1);
+  /// @brief Cells i with l1[i] - l0[i] >= margin, ascending, into cells.
+  /// @return number of cells.
+  int (*scan_margin)(const float* l0, const float* l1, int size, float margin, int* cells);
+
+  /// @brief Vertical pass of a resize, see warp.cpp:
+  /// out[x] = r0[x] * b0 + r1[x] * b1 for x < w, rounded as that reads, so
+  /// the same as resize_bilinear in every variant.
+  void (*lerp_rows)(const float* r0, const float* r1, float b0, float b1, int w, float* out);
+};
+
+/// @brief Name of isa, e.g. "AVX2".
+const char* IsaName(Isa isa);
+
+/// @brief Best instruction set the CPU has and the OS saves the registers
+/// of, from CPUID and XGETBV. ISA_BASELINE off x86.
+Isa CpuIsa();
+
+/// @brief Kernels built for isa, null if this build has none.
+const Kernels* KernelsFor(Isa isa);
+
+/// @brief Kernels of the best instruction set of both the CPU and the
+/// build, chosen at the first call. Environment variable MTCNN_ISA, one of
+/// the IsaName names, caps the choice, e.g. to compare variants.
+const Kernels & GetKernels();
+
+// Kernels of each variant, null when its file isn't built with the flags
+// of the instruction set, see CMakeLists.txt.
+namespace baseline { const Kernels* IsaKernels(); }
+namespace sse42 { const Kernels* IsaKernels(); }
+namespace avx2 { const Kernels* IsaKernels(); }
+namespace avx512 { const Kernels* IsaKernels(); }
+
+} // namespace face
+
+#endif // FACE_KERNELS_H_
@@ -0,0 +1,10 @@
+// AVX2 kernels, built with -mavx2 -mfma or /arch:AVX2 on x86.
+#if defined(__AVX2__) && (defined(__FMA__) || defined(_MSC_VER))
+#define FACE_SIMD_AVX2
+#define FACE_KERNELS_NS avx2
+#define FACE_KERNELS_ISA ISA_AVX2
+#include "kernels_impl.h"
+#else
+#include "kernels.h"
+const face::Kernels* face::avx2::IsaKernels() { return nullptr; }
+#endif
@@ -0,0 +1,10 @@
+// AVX-512 kernels, built with -mavx512f or /arch:AVX512 on x86.
+#if defined(__AVX512F__)
+#define FACE_SIMD_AVX512
+#define FACE_KERNELS_NS avx512
+#define FACE_KERNELS_ISA ISA_AVX512
+#include "kernels_impl.h"
+#else
+#include "kernels.h"
+const face::Kernels* face::avx512::IsaKernels() { return nullptr; }
+#endif
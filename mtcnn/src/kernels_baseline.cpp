@@ -0,0 +1,4 @@
+// Baseline kernels, built with the flags of the whole project.
+#define FACE_KERNELS_NS baseline
+#define FACE_KERNELS_ISA ISA_BASELINE
+#include "kernels_impl.h"
@@ -0,0 +1,205 @@
+// Kernels of kernels.h on the vectors of simd.h, included once by each
+// kernels_<isa>.cpp, which names its variant with FACE_KERNELS_NS and
+// FACE_KERNELS_ISA and selects the vectors with FACE_SIMD_<isa>. No include
+// guard: a file includes it once. Nothing here may come from a header with
+// inline code shared by other files, e.g. std templates or ncnn::Mat, since
+// the linker could keep the copy built for an instruction set the CPU lacks.
+#include "kernels.h"
+#include "simd.h"
+
+namespace face
+{
+namespace FACE_KERNELS_NS
+{
+namespace
+{
+// Sums of n vectors from x of kConv3x3Block outputs, rows of the input
+// channels w floats apart, bias and PReLU applied, into out.
+template <int n>
+inline void ConvBlock(const float* const* in, int channels, int w, int x,
+  const float* kernel, const simd::Float* bias, const simd::Float* slope, float* const* out)
+{
+  simd::Float acc[kConv3x3Block][n];
+  for (int i = 0; i < kConv3x3Block; i++) {
+    for (int j = 0; j < n; j++)
+      acc[i][j] = bias[i];
+  }
+  for (int q = 0; q < channels; q++) {
+    for (int ky = 0; ky < 3; ky++) {
+      const float* row = in[q] + ky * w + x;
+      for (int kx = 0; kx < 3; kx++, kernel += kConv3x3Block) {
+        simd::Float v[n];
+        for (int j = 0; j < n; j++)
+          v[j] = simd::Load(row + kx + j * simd::kWidth);
+        for (int i = 0; i < kConv3x3Block; i++) {
+          simd::Float k = simd::Set1(kernel[i]);
+          for (int j = 0; j < n; j++)
+            acc[i][j] = simd::MulAdd(k, v[j], acc[i][j]);
+        }
+      }
+    }
+  }
+  for (int i = 0; i < kConv3x3Block; i++) {
+    for (int j = 0; j < n; j++)
+      simd::Store(out[i] + x + j * simd::kWidth, simd::PReLU(acc[i][j], slope[i]));
+  }
+}
+
+// Widths not filling a vector end with one overlapping the last, and rows
+// narrower than a vector are summed one by one.
+void ConvRow(const float* const* in, int channels, int w, int outw,
+  const float* kernel, const float* bias, const float* slope, float* const* out)
+{
+  simd::Float bias_v[kConv3x3Block], slope_v[kConv3x3Block];
+  for (int i = 0; i < kConv3x3Block; i++) {
+    bias_v[i] = simd::Set1(bias[i]);
+    slope_v[i] = simd::Set1(slope[i]);
+  }
+  const int step = 2 * simd::kWidth;
+  int x = 0;
+  for (; x + step <= outw; x += step)
+    ConvBlock<2>(in, channels, w, x, kernel, bias_v, slope_v, out);
+  for (; x + simd::kWidth <= outw; x += simd::kWidth)
+    ConvBlock<1>(in, channels, w, x, kernel, bias_v, slope_v, out);
+  if (x < outw && outw >= simd::kWidth) {
+    ConvBlock<1>(in, channels, w, outw - simd::kWidth, kernel, bias_v, slope_v, out);
+    return;
+  }
+  for (; x < outw; x++) {
+    const float* k = kernel;
+    float acc[kConv3x3Block];
+    for (int i = 0; i < kConv3x3Block; i++)
+      acc[i] = bias[i];
+    for (int q = 0; q < channels; q++) {
+      for (int ky = 0; ky < 3; ky++) {
+        for (int kx = 0; kx < 3; kx++, k += kConv3x3Block) {
+          float v = in[q][ky * w + x + kx];
+          for (int i = 0; i < kConv3x3Block; i++)
+            acc[i] += k[i] * v;
+        }
+      }
+    }
+    for (int i = 0; i < kConv3x3Block; i++)
+      out[i][x] = acc[i] > 0 ? acc[i] : acc[i] * slope[i];
+  }
+}
+
+void MaxRows(float* r0, const float* r1, int w)
+{
+  int x = 0;
+  for (; x + simd::kWidth <= w; x += simd::kWidth)
+    simd::Store(r0 + x, simd::Max(simd::Load(r0 + x), simd::Load(r1 + x)));
+  for (; x < w; x++)
+    r0[x] = r0[x] > r1[x] ? r0[x] : r1[x];
+}
+
+void SuppressAll(const int* x1s, const int* y1s, const int* x2s, const int* y2s,
+  const int* areas, int i, int n, float threshold, bool min_overlap, uint64_t* suppressed)
+{
+  int padded = (n + kKernelPad - 1) / kKernelPad * kKernelPad;
+  // Groups start at a multiple of the width, so their bits never straddle
+  // two words.
+  int j = (i + 1) & ~(simd::kWidth - 1);
+  simd::Int mx1 = simd::Set1Int(x1s[i]);
+  simd::Int my1 = simd::Set1Int(y1s[i]);
+  simd::Int mx2 = simd::Set1Int(x2s[i]);
+  simd::Int my2 = simd::Set1Int(y2s[i]);
+  simd::Int marea = simd::Set1Int(areas[i]);
+  simd::Int zero = simd::Set1Int(0);
+  simd::Float thresh = simd::Set1(threshold);
+  // overlap of boxes not intersecting is 0
+  unsigned outside = threshold < 0.f ? (1u << simd::kWidth) - 1 : 0u;
+  for (; j < padded; j += simd::kWidth) {
+    simd::Int x1 = simd::MaxInt(mx1, simd::LoadInt(x1s + j));
+    simd::Int y1 = simd::MaxInt(my1, simd::LoadInt(y1s + j));
+    simd::Int x2 = simd::MinInt(mx2, simd::LoadInt(x2s + j));
+    simd::Int y2 = simd::MinInt(my2, simd::LoadInt(y2s + j));
+    simd::Int w = simd::SubInt(x2, x1);
+    simd::Int h = simd::SubInt(y2, y1);
+    unsigned inside = simd::Bits(simd::GreaterInt(w, zero)) &
+      simd::Bits(simd::GreaterInt(h, zero));
+    simd::Int inter = simd::MulInt(w, h);
+    simd::Int barea = simd::LoadInt(areas + j);
+    simd::Int outer = min_overlap ? simd::MinInt(marea, barea) :
+      simd::SubInt(simd::AddInt(marea, barea), inter);
+    simd::Float overlap = simd::Div(simd::ToFloat(inter), simd::ToFloat(outer));
+    unsigned over = simd::Bits(simd::Greater(overlap, thresh));
+    over = (inside & over) | (~inside & outside);
+    suppressed[j >> 6] |= static_cast<uint64_t>(over) << (j & 63);
+  }
+}
+
+void Logits2(const float* bottom, size_t cstep, int channels, int size,
+  const float* w0, const float* w1, float b0, float b1, float* l0, float* l1)
+{
+  int i = 0;
+  for (; i + simd::kWidth <= size; i += simd::kWidth) {
+    simd::Float s0 = simd::Set1(b0);
+    simd::Float s1 = simd::Set1(b1);
+    for (int q = 0; q < channels; q++) {
+      simd::Float v = simd::Load(bottom + q * cstep + i);
+      s0 = simd::MulAdd(v, simd::Set1(w0[q]), s0);
+      s1 = simd::MulAdd(v, simd::Set1(w1[q]), s1);
+    }
+    simd::Store(l0 + i, s0);
+    simd::Store(l1 + i, s1);
+  }
+  for (; i < size; i++) {
+    float s0 = b0, s1 = b1;
+    for (int q = 0; q < channels; q++) {
+      s0 += bottom[q * cstep + i] * w0[q];
+      s1 += bottom[q * cstep + i] * w1[q];
+    }
+    l0[i] = s0;
+    l1[i] = s1;
+  }
+}
+
+int ScanMargin(const float* l0, const float* l1, int size, float margin, int* cells)
+{
+  simd::Float m = simd::Set1(margin);
+  int count = 0;
+  int i = 0;
+  for (; i + simd::kWidth <= size; i += simd::kWidth) {
+    unsigned bits = simd::Bits(simd::GreaterEqual(
+      simd::Sub(simd::Load(l1 + i), simd::Load(l0 + i)), m));
+    // most groups have none
+    for (int k = 0; bits; k++, bits >>= 1) {
+      if (bits & 1)
+        cells[count++] = i + k;
+    }
+  }
+  for (; i < size; i++) {
+    if (l1[i] - l0[i] >= margin)
+      cells[count++] = i;
+  }
+  return count;
+}
+
+// No MulAdd, and the kernels are built with -ffp-contract=off, so each product
+// is rounded as in resize_bilinear.
+void LerpRows(const float* r0, const float* r1, float b0, float b1, int w, float* out)
+{
+  simd::Float v0 = simd::Set1(b0);
+  simd::Float v1 = simd::Set1(b1);
+  int x = 0;
+  for (; x + simd::kWidth <= w; x += simd::kWidth) {
+    simd::Store(out + x, simd::Add(simd::Mul(simd::Load(r0 + x), v0),
+      simd::Mul(simd::Load(r1 + x), v1)));
+  }
+  for (; x < w; x++)
+    out[x] = r0[x] * b0 + r1[x] * b1;
+}
+} // namespace
+
+const Kernels* IsaKernels()
+{
+  static const Kernels kernels = {
+    FACE_KERNELS_ISA, simd::kName, simd::kWidth,
+    ConvRow, MaxRows, SuppressAll, Logits2, ScanMargin, LerpRows
+  };
+  return &kernels;
+}
+
+} // namespace FACE_KERNELS_NS
+} // namespace face
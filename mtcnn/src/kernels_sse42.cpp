@@ -0,0 +1,10 @@
+// SSE4.2 kernels, built with -msse4.2 on x86, which MSVC doesn't need.
+#if defined(__SSE4_2__) || (defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86)))
+#define FACE_SIMD_SSE42
+#define FACE_KERNELS_NS sse42
+#define FACE_KERNELS_ISA ISA_SSE42
+#include "kernels_impl.h"
+#else
+#include "kernels.h"
+const face::Kernels* face::sse42::IsaKernels() { return nullptr; }
+#endif
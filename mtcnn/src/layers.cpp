@@ -0,0 +1,451 @@
+#include <algorithm>  // std::min, std::max
+#include <cfloat>     // FLT_MAX
+#include <cmath>      // exp, log
+
+#include "conv3x3.h"
+#include "half.h"
+#include "kernels.h"
+#include "layers.h"
+
+namespace face
+{
+DEFINE_LAYER_CREATOR(MaskPooling)
+DEFINE_LAYER_CREATOR(TilePooling)
+DEFINE_LAYER_CREATOR(TileFlatten)
+DEFINE_LAYER_CREATOR(PnetHead)
+DEFINE_LAYER_CREATOR(HalfInnerProduct)
+DEFINE_LAYER_CREATOR(ConvPReLU)
+
+static const struct {
+  const char* type;
+  ncnn::layer_creator_func creator;
+} custom_layers[CUSTOM_LAYER_COUNT] = {
+  {"MaskPooling", MaskPooling_layer_creator},
+  {"TilePooling", TilePooling_layer_creator},
+  {"TileFlatten", TileFlatten_layer_creator},
+  {"PnetHead", PnetHead_layer_creator},
+  {"HalfInnerProduct", HalfInnerProduct_layer_creator},
+  {"ConvPReLU", ConvPReLU_layer_creator}
+};
+
+const char* CustomLayerType(int index)
+{
+  return index >= 0 && index < CUSTOM_LAYER_COUNT ? custom_layers[index].type : 0;
+}
+
+void RegisterCustomLayers(ncnn::Net & net)
+{
+  for (const auto & layer : custom_layers)
+    net.register_custom_layer(layer.type, layer.creator);
+}
+
+MaskPooling::MaskPooling()
+{
+  one_blob_only = false;
+  support_inplace = false;
+}
+
+int MaskPooling::load_param(const ncnn::ParamDict & pd)
+{
+  int pooling_type = pd.get(0, 0);
+  kernel = pd.get(1, 0);
+  stride = pd.get(2, 1);
+  // only max pooling
+  if (pooling_type != 0)
+    return -1;
+  return 0;
+}
+
+int MaskPooling::forward(const std::vector<ncnn::Mat> & bottom_blobs,
+  std::vector<ncnn::Mat> & top_blobs, const ncnn::Option & opt) const
+{
+  const ncnn::Mat & bottom_blob = bottom_blobs[0];
+  const ncnn::Mat & mask = bottom_blobs[1];
+  int w = bottom_blob.w;
+  int h = bottom_blob.h;
+  int channels = bottom_blob.c;
+  if (mask.w != w || mask.h != h)
+    return -1;
+  int outw = (w - kernel + stride - 1) / stride + 1;
+  int outh = (h - kernel + stride - 1) / stride + 1;
+
+  ncnn::Mat & top_blob = top_blobs[0];
+  top_blob.create(outw, outh, channels, 4u, opt.blob_allocator);
+  if (top_blob.empty())
+    return -100;
+
+  for (int q = 0; q < channels; q++) {
+    const ncnn::Mat m = bottom_blob.channel(q);
+    float* outptr = top_blob.channel(q);
+    for (int i = 0; i < outh; i++) {
+      int y1 = i * stride;
+      int y2 = std::min<int>(y1 + kernel, h);
+      for (int j = 0; j < outw; j++) {
+        int x1 = j * stride;
+        int x2 = std::min<int>(x1 + kernel, w);
+        float max = -FLT_MAX;
+        bool any = false;
+        for (int y = y1; y < y2; y++) {
+          const float* ptr = m.row(y);
+          const float* mptr = mask.row(y);
+          for (int x = x1; x < x2; x++) {
+            if (mptr[x] != 0.f) {
+              max = std::max<float>(max, ptr[x]);
+              any = true;
+            }
+          }
+        }
+        // guard gap between levels
+        outptr[j] = any ? max : 0.f;
+      }
+      outptr += outw;
+    }
+  }
+  return 0;
+}
+
+TilePooling::TilePooling()
+{
+  one_blob_only = true;
+  support_inplace = false;
+}
+
+int TilePooling::load_param(const ncnn::ParamDict & pd)
+{
+  int pooling_type = pd.get(0, 0);
+  kernel = pd.get(1, 0);
+  stride = pd.get(2, 1);
+  pitch = pd.get(11, 0);
+  valid = pd.get(12, 0);
+  // only max pooling over tiles aligned to stride
+  if (pooling_type != 0 || pitch % stride != 0 || valid > pitch)
+    return -1;
+  return 0;
+}
+
+int TilePooling::forward(const ncnn::Mat & bottom_blob, ncnn::Mat & top_blob,
+  const ncnn::Option & opt) const
+{
+  int w = bottom_blob.w;
+  int h = bottom_blob.h;
+  int channels = bottom_blob.c;
+  // the last tile may be cut short by the convolution before
+  int tiles = (h + pitch - 1) / pitch;
+  int outw = (w - kernel + stride - 1) / stride + 1;
+  int out_pitch = pitch / stride;
+  int out_valid = (valid - kernel + stride - 1) / stride + 1;
+
+  top_blob.create(outw, tiles * out_pitch, channels, 4u, opt.blob_allocator);
+  if (top_blob.empty())
+    return -100;
+
+  for (int q = 0; q < channels; q++) {
+    const ncnn::Mat m = bottom_blob.channel(q);
+    float* outptr = top_blob.channel(q);
+    for (int t = 0; t < tiles; t++) {
+      int tile_end = std::min<int>(t * pitch + valid, h);
+      for (int i = 0; i < out_pitch; i++, outptr += outw) {
+        if (i >= out_valid) {
+          std::fill(outptr, outptr + outw, 0.f);
+          continue;
+        }
+        int y1 = t * pitch + i * stride;
+        int y2 = std::min<int>(y1 + kernel, tile_end);
+        for (int j = 0; j < outw; j++) {
+          int x1 = j * stride;
+          int x2 = std::min<int>(x1 + kernel, w);
+          float max = -FLT_MAX;
+          for (int y = y1; y < y2; y++) {
+            const float* ptr = m.row(y);
+            for (int x = x1; x < x2; x++)
+              max = std::max<float>(max, ptr[x]);
+          }
+          outptr[j] = max;
+        }
+      }
+    }
+  }
+  return 0;
+}
+
+TileFlatten::TileFlatten()
+{
+  one_blob_only = true;
+  support_inplace = false;
+}
+
+int TileFlatten::load_param(const ncnn::ParamDict & pd)
+{
+  pitch = pd.get(11, 0);
+  valid = pd.get(12, 0);
+  if (valid > pitch)
+    return -1;
+  return 0;
+}
+
+int TileFlatten::forward(const ncnn::Mat & bottom_blob, ncnn::Mat & top_blob,
+  const ncnn::Option & opt) const
+{
+  int w = bottom_blob.w;
+  int h = bottom_blob.h;
+  int channels = bottom_blob.c;
+  int tiles = (h + pitch - 1) / pitch;
+  int size = valid * w;
+
+  top_blob.create(tiles, 1, channels * size, 4u, opt.blob_allocator);
+  if (top_blob.empty())
+    return -100;
+
+  for (int q = 0; q < channels; q++) {
+    const ncnn::Mat m = bottom_blob.channel(q);
+    for (int t = 0; t < tiles; t++) {
+      const float* ptr = m.row(t * pitch);
+      for (int i = 0; i < size; i++)
+        top_blob.channel(q * size + i)[t] = ptr[i];
+    }
+  }
+  return 0;
+}
+
+PnetHead::PnetHead()
+{
+  one_blob_only = false;
+  support_inplace = false;
+}
+
+int PnetHead::load_param(const ncnn::ParamDict & pd)
+{
+  num_input = pd.get(0, 0);
+  return 0;
+}
+
+int PnetHead::load_model(const ncnn::ModelBin & mb)
+{
+  // same order and types as the two Convolution layers it replaces
+  conf_weight = mb.load(2 * num_input, 0);
+  conf_bias = mb.load(2, 1);
+  loc_weight = mb.load(4 * num_input, 0);
+  loc_bias = mb.load(4, 1);
+  if (conf_weight.empty() || conf_bias.empty() || loc_weight.empty() || loc_bias.empty())
+    return -100;
+  return 0;
+}
+
+int PnetHead::forward(const std::vector<ncnn::Mat> & bottom_blobs,
+  std::vector<ncnn::Mat> & top_blobs, const ncnn::Option & opt) const
+{
+  const ncnn::Mat & bottom_blob = bottom_blobs[0];
+  float threshold = bottom_blobs[1][0];
+  int size = bottom_blob.w * bottom_blob.h;
+  if (bottom_blob.c != num_input)
+    return -1;
+
+  // conv4-1 logits of every cell
+  ncnn::Mat logits(size, 2, 4u, opt.workspace_allocator);
+  if (logits.empty())
+    return -100;
+  const Kernels & kernels = GetKernels();
+  const float* w0 = conf_weight;
+  const float* w1 = w0 + num_input;
+  float* l0 = logits.row(0);
+  float* l1 = logits.row(1);
+  kernels.logits2(bottom_blob, bottom_blob.cstep, num_input, size, w0, w1,
+    conf_bias[0], conf_bias[1], l0, l1);
+
+  // prob1 >= threshold needs l1 - l0 >= log(threshold / (1 - threshold)).
+  // The margin is lowered a little so rounding never drops a cell, passing
+  // cells are then checked on the softmax itself.
+  float margin = -FLT_MAX;
+  double lower = threshold * (1 - 1e-3);
+  if (lower >= 1)
+    margin = FLT_MAX;
+  else if (lower > 0)
+    margin = static_cast<float>(log(lower / (1 - lower)) - 1e-3);
+
+  ncnn::Mat cells(size, 4u, opt.workspace_allocator);
+  ncnn::Mat probs(size, 4u, opt.workspace_allocator);
+  if (cells.empty() || probs.empty())
+    return -100;
+  int* cell_ptr = cells;
+  float* prob_ptr = probs;
+  int passed = kernels.scan_margin(l0, l1, size, margin, cell_ptr);
+  int count = 0;
+  for (int k = 0; k < passed; k++) {
+    int i = cell_ptr[k];
+    // softmax as prob1 computes it
+    float max = std::max<float>(l0[i], l1[i]);
+    float e0 = exp(l0[i] - max);
+    float e1 = exp(l1[i] - max);
+    float prob = e1 / (e0 + e1);
+    if (prob >= threshold) {
+      cell_ptr[count] = i;
+      prob_ptr[count] = prob;
+      count++;
+    }
+  }
+
+  ncnn::Mat & top_blob = top_blobs[0];
+  if (count == 0) {
+    top_blob = ncnn::Mat();
+    return 0;
+  }
+  top_blob.create(7, count, 4u, opt.blob_allocator);
+  if (top_blob.empty())
+    return -100;
+  for (int k = 0; k < count; k++) {
+    int i = cell_ptr[k];
+    float* row = top_blob.row(k);
+    row[0] = static_cast<float>(i % bottom_blob.w);
+    row[1] = static_cast<float>(i / bottom_blob.w);
+    row[2] = prob_ptr[k];
+    // conv4-2 at this cell only
+    const float* ptr = (const float*)bottom_blob.data + i;
+    for (int p = 0; p < 4; p++) {
+      const float* w = (const float*)loc_weight + p * num_input;
+      float sum = loc_bias[p];
+      for (int q = 0; q < num_input; q++)
+        sum += ptr[q * bottom_blob.cstep] * w[q];
+      row[3 + p] = sum;
+    }
+  }
+  return 0;
+}
+
+HalfInnerProduct::HalfInnerProduct()
+{
+  one_blob_only = true;
+  support_inplace = false;
+}
+
+int HalfInnerProduct::load_param(const ncnn::ParamDict & pd)
+{
+  num_output = pd.get(0, 0);
+  bias_term = pd.get(1, 0);
+  weight_data_size = pd.get(2, 0);
+  per_position = pd.get(3, 0);
+  if (num_output <= 0 || weight_data_size % num_output != 0)
+    return -1;
+  return 0;
+}
+
+int HalfInnerProduct::load_model(const ncnn::ModelBin & mb)
+{
+  // expanded to float by ModelBin, so kept back as float16
+  ncnn::Mat weights = mb.load(weight_data_size, 0);
+  if (weights.empty())
+    return -100;
+  weight_data.create(weight_data_size, (size_t)2u);
+  if (weight_data.empty())
+    return -100;
+  const float* src = weights;
+  unsigned short* dst = (unsigned short*)weight_data.data;
+  for (int i = 0; i < weight_data_size; i++)
+    dst[i] = HalfFromFloat(src[i]);
+  if (bias_term) {
+    bias_data = mb.load(num_output, 1);
+    if (bias_data.empty())
+      return -100;
+  }
+  return 0;
+}
+
+int HalfInnerProduct::forward(const ncnn::Mat & bottom_blob, ncnn::Mat & top_blob,
+  const ncnn::Option & opt) const
+{
+  int w = bottom_blob.w;
+  int h = bottom_blob.h;
+  int channels = bottom_blob.c;
+  int size = w * h;
+  int num_input = weight_data_size / num_output;
+  if (per_position ? channels != num_input : size * channels != num_input)
+    return -1;
+
+  if (per_position)
+    top_blob.create(w, h, num_output, 4u, opt.blob_allocator);
+  else
+    top_blob.create(num_output, 4u, opt.blob_allocator);
+  if (top_blob.empty())
+    return -100;
+  ncnn::Mat row(num_input, 4u, opt.workspace_allocator);
+  if (row.empty())
+    return -100;
+
+  float* r = row;
+  for (int p = 0; p < num_output; p++) {
+    const unsigned short* weights = (const unsigned short*)weight_data.data + num_input * p;
+    for (int i = 0; i < num_input; i++)
+      r[i] = FloatFromHalf(weights[i]);
+    float bias = bias_term ? bias_data[p] : 0.f;
+    if (!per_position) {
+      // inputs in the order InnerProduct flattens them, channel by channel
+      float sum = bias;
+      for (int q = 0; q < channels; q++) {
+        const float* ptr = bottom_blob.channel(q);
+        const float* wq = r + size * q;
+        for (int i = 0; i < size; i++)
+          sum += ptr[i] * wq[i];
+      }
+      top_blob[p] = sum;
+      continue;
+    }
+    float* out = top_blob.channel(p);
+    std::fill(out, out + size, bias);
+    for (int q = 0; q < channels; q++) {
+      const float* ptr = bottom_blob.channel(q);
+      for (int i = 0; i < size; i++)
+        out[i] += r[q] * ptr[i];
+    }
+  }
+  return 0;
+}
+
+ConvPReLU::ConvPReLU()
+{
+  one_blob_only = true;
+  support_inplace = false;
+}
+
+int ConvPReLU::load_param(const ncnn::ParamDict & pd)
+{
+  num_output = pd.get(0, 0);
+  bias_term = pd.get(1, 0);
+  weight_data_size = pd.get(2, 0);
+  num_slope = pd.get(3, num_output);
+  pool = pd.get(4, 0);
+  if (num_output <= 0 || weight_data_size % (num_output * 9) != 0 ||
+    (num_slope != 1 && num_slope != num_output))
+    return -1;
+  return 0;
+}
+
+int ConvPReLU::load_model(const ncnn::ModelBin & mb)
+{
+  ncnn::Mat weights = mb.load(weight_data_size, 0);
+  // float or float16 expanded by ModelBin, int8 weights have no kernel here
+  if (weights.empty() || weights.elemsize != 4)
+    return -100;
+  weight_data = PackConv3x3(weights, num_output, weight_data_size / num_output / 9);
+  if (weight_data.empty())
+    return -100;
+  if (bias_term) {
+    bias_data = mb.load(num_output, 1);
+    if (bias_data.empty())
+      return -100;
+  }
+  slope_data = mb.load(num_slope, 1);
+  if (slope_data.empty())
+    return -100;
+  return 0;
+}
+
+int ConvPReLU::forward(const ncnn::Mat & bottom_blob, ncnn::Mat & top_blob,
+  const ncnn::Option & opt) const
+{
+  if (bottom_blob.c * num_output * 9 != weight_data_size)
+    return -1;
+  return ConvPReLU3x3(bottom_blob, top_blob, weight_data,
+    bias_term ? (const float*)bias_data : 0, slope_data, num_slope, num_output,
+    pool != 0, opt.blob_allocator, opt.workspace_allocator);
+}
+
+} // namespace face
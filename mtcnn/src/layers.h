@@ -0,0 +1,160 @@
+#ifndef FACE_LAYERS_H_
+#define FACE_LAYERS_H_
+
+// ncnn
+#include "layer.h"
+#include "net.h"
+
+namespace face
+{
+// Max pooling over a pyramid mosaic, bottoms are [feature, mask].
+// Elements with mask 0 are skipped, as if every level were padded with -inf
+// on its own, like ncnn Pooling pads a single level.
+// params: 0=pooling_type(max only) 1=kernel 2=stride
+class MaskPooling : public ncnn::Layer
+{
+public:
+  MaskPooling();
+  virtual int load_param(const ncnn::ParamDict & pd);
+  virtual int forward(const std::vector<ncnn::Mat> & bottom_blobs,
+    std::vector<ncnn::Mat> & top_blobs, const ncnn::Option & opt) const;
+
+  int kernel;
+  int stride;
+};
+
+// Custom ncnn layers for running R/O-Net on crops stacked vertically into
+// one tall blob. Every crop occupies a tile of `pitch` rows, of which only
+// the first `valid` rows hold data that a single-crop forward would see.
+
+// Max pooling which pads the tail of every tile with -inf, exactly like
+// ncnn Pooling pads the tail of a single crop.
+// params: 0=pooling_type(max only) 1=kernel 2=stride 11=pitch 12=valid
+class TilePooling : public ncnn::Layer
+{
+public:
+  TilePooling();
+  virtual int load_param(const ncnn::ParamDict & pd);
+  virtual int forward(const ncnn::Mat & bottom_blob, ncnn::Mat & top_blob,
+    const ncnn::Option & opt) const;
+
+  int kernel;
+  int stride;
+  int pitch;
+  int valid;
+};
+
+// Flatten the valid rows of every tile into one column, in the order
+// InnerProduct reads its input, so that fc layers become 1x1 convolutions.
+// Output shape is (w=tiles, h=1, c=channels*valid*w).
+// params: 11=pitch 12=valid
+class TileFlatten : public ncnn::Layer
+{
+public:
+  TileFlatten();
+  virtual int load_param(const ncnn::ParamDict & pd);
+  virtual int forward(const ncnn::Mat & bottom_blob, ncnn::Mat & top_blob,
+    const ncnn::Option & opt) const;
+
+  int pitch;
+  int valid;
+};
+
+// Pnet head fusing conv4-1, prob1 softmax and conv4-2, bottoms are
+// [feature, threshold]. Emits only cells whose face probability reaches
+// threshold, in row major order, as rows of (x, y, prob, 4 regressions).
+// Cells below the logit margin of threshold never reach softmax, and
+// regressions are computed for emitted cells only.
+// params: 0=num_input
+// weights: conv4-1 weight and bias, then conv4-2 weight and bias.
+class PnetHead : public ncnn::Layer
+{
+public:
+  PnetHead();
+  virtual int load_param(const ncnn::ParamDict & pd);
+  virtual int load_model(const ncnn::ModelBin & mb);
+  virtual int forward(const std::vector<ncnn::Mat> & bottom_blobs,
+    std::vector<ncnn::Mat> & top_blobs, const ncnn::Option & opt) const;
+
+  int num_input;
+  ncnn::Mat conf_weight, conf_bias;  // 2 outputs
+  ncnn::Mat loc_weight, loc_bias;    // 4 outputs
+};
+
+// InnerProduct keeping its weights as float16 in memory, half the size of
+// float ones, each output's row converted to float while computing it.
+// With per_position every w x h position of the bottom is an input of
+// `channels` values, as for the 1x1 Convolution running an fc layer on
+// tiles, and the output is w x h x num_output.
+// params: 0=num_output 1=bias_term 2=weight_data_size 3=per_position
+// weights: as InnerProduct, stored as float16 or float.
+class HalfInnerProduct : public ncnn::Layer
+{
+public:
+  HalfInnerProduct();
+  virtual int load_param(const ncnn::ParamDict & pd);
+  virtual int load_model(const ncnn::ModelBin & mb);
+  virtual int forward(const ncnn::Mat & bottom_blob, ncnn::Mat & top_blob,
+    const ncnn::Option & opt) const;
+
+  int num_output;
+  int bias_term;
+  int weight_data_size;
+  int per_position;
+  ncnn::Mat weight_data;  // float16, a row of each output
+  ncnn::Mat bias_data;
+};
+
+// 3x3 Convolution with stride 1 and no padding, its PReLU, and with pool
+// the 2x2 stride 2 max Pooling after it, in one pass of the conv3x3.h
+// kernels. Replaces conv1-conv3 of Pnet, whose thin channels the stock
+// layers are not tuned for, reading the weights of the layers it replaces.
+// params: 0=num_output 1=bias_term 2=weight_data_size 3=num_slope 4=pool
+// weights: Convolution weight and bias, then PReLU slopes, all float.
+class ConvPReLU : public ncnn::Layer
+{
+public:
+  ConvPReLU();
+  virtual int load_param(const ncnn::ParamDict & pd);
+  virtual int load_model(const ncnn::ModelBin & mb);
+  virtual int forward(const ncnn::Mat & bottom_blob, ncnn::Mat & top_blob,
+    const ncnn::Option & opt) const;
+
+  int num_output;
+  int bias_term;
+  int weight_data_size;
+  int num_slope;
+  int pool;
+  ncnn::Mat weight_data;  // packed by PackConv3x3
+  ncnn::Mat bias_data;
+  ncnn::Mat slope_data;
+};
+
+// Custom layers in the order they are registered into every net, so in
+// binary params layer type CustomBit | index of a custom layer is its
+// index here.
+enum CustomLayerIndex {
+  CUSTOM_MASK_POOLING,
+  CUSTOM_TILE_POOLING,
+  CUSTOM_TILE_FLATTEN,
+  CUSTOM_PNET_HEAD,
+  CUSTOM_HALF_INNER_PRODUCT,
+  CUSTOM_CONV_PRELU,
+  CUSTOM_LAYER_COUNT
+};
+
+/// @brief Type name of a custom layer index, as in text params.
+const char* CustomLayerType(int index);
+/// @brief Register all custom layers into net, in CustomLayerIndex order.
+void RegisterCustomLayers(ncnn::Net & net);
+
+ncnn::Layer* MaskPooling_layer_creator();
+ncnn::Layer* PnetHead_layer_creator();
+ncnn::Layer* TilePooling_layer_creator();
+ncnn::Layer* TileFlatten_layer_creator();
+ncnn::Layer* HalfInnerProduct_layer_creator();
+ncnn::Layer* ConvPReLU_layer_creator();
+
+} // namespace face
+
+#endif // FACE_LAYERS_H_
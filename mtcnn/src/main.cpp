@@ -1,6 +1,18 @@
+#include <algorithm>
 #include <iostream>
 #include <opencv2/opencv.hpp>
+#include "calibration.h"
+#include "conv3x3.h"
+#include "half.h"
+#include "kernels.h"
+#include "layers.h"
+#include "model_file.h"
+#include "model_ids.h"
 #include "mtcnn.h"
+#include "nms.h"
+#include "pipeline_detector.h"
+#include "video_detector.h"
+#include "warp.h"
 
 using namespace std;
 using namespace cv;
@@ -32,6 +44,31 @@ string cpu_info()
 }
 #endif
 
+#ifdef _MSC_VER
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+// Bytes of the working set of the process.
+size_t resident_memory()
+{
+  PROCESS_MEMORY_COUNTERS counters;
+  if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    return 0;
+  return counters.WorkingSetSize;
+}
+#else
+#include <unistd.h>
+// Bytes of the resident set of the process.
+size_t resident_memory()
+{
+  ifstream file("/proc/self/statm");
+  size_t pages = 0, resident = 0;
+  file >> pages >> resident;
+  return resident * sysconf(_SC_PAGESIZE);
+}
+#endif
+
 Mat imdraw(const Mat im, const vector<BBox> & bboxes)
 {
   Mat canvas = im.clone();
@@ -49,8 +86,7 @@ Mat imdraw(const Mat im, const vector<BBox> & bboxes)
 void demo() {
   Mtcnn mtcnn("../models");
   Mat im = imread("../sample.jpg");
-  ncnn::Mat image = ncnn::Mat::from_pixels(im.data, ncnn::Mat::PIXEL_BGR, im.cols, im.rows);
-  vector<BBox> bboxes = mtcnn.Detect(image);
+  vector<BBox> bboxes = mtcnn.Detect(ImageView(im.data, im.cols, im.rows, (int)im.step[0]));
   Mat canvas = imdraw(im, bboxes);
   imshow("mtcnn face detector", canvas);
   cv::waitKey(0);
@@ -73,6 +109,424 @@ void performance(bool lnet = true, int ntimes = 50) {
   cout << "detect time: " << (double)(end - begin) / ntimes << " ms" << endl;
 }
 
+// Detect from a float copy of frame against detect from its bytes.
+void pixel_performance(int ntimes = 20) {
+  Mtcnn mtcnn("../models");
+  Mat im = imread("../sample.jpg");
+  string disc_pad = "=============";
+  cout << disc_pad << " u8 input " << disc_pad << endl;
+  cout << "cpu info: " << cpu_info() << endl;
+  cout << "image shape: (" << im.cols << ", " << im.rows << ", " << im.channels() << ")" << endl;
+  clock_t begin = clock();
+  for (int i = 0; i < ntimes; i++) {
+    ncnn::Mat image = ncnn::Mat::from_pixels(im.data, ncnn::Mat::PIXEL_BGR, im.cols, im.rows);
+    mtcnn.Detect(image);
+  }
+  clock_t middle = clock();
+  for (int i = 0; i < ntimes; i++)
+    mtcnn.Detect(im.data, im.cols, im.rows, (int)im.step[0], PIXEL_BGR);
+  clock_t end = clock();
+  cout << "float detect time: " << (double)(middle - begin) * 1000 / CLOCKS_PER_SEC / ntimes << " ms" << endl;
+  cout << "u8 detect time: " << (double)(end - middle) * 1000 / CLOCKS_PER_SEC / ntimes << " ms" << endl;
+}
+
+void batch_performance(int ntimes = 10) {
+  Mtcnn mtcnn("../models");
+  Mat im = imread("../sample.jpg");
+  ncnn::Mat image = ncnn::Mat::from_pixels(im.data, ncnn::Mat::PIXEL_BGR, im.cols, im.rows);
+  string disc_pad = "=============";
+  cout << disc_pad << " R/O/Lnet batch " << disc_pad << endl;
+  cout << "cpu info: " << cpu_info() << endl;
+  cout << "candidates\tper-candidate (ms)\tbatched (ms)" << endl;
+  srand(0);
+  for (int count : {1, 10, 50, 100, 200, 500}) {
+    // random square proposals all over the image
+    vector<BBox> proposals(count);
+    for (auto & bbox : proposals) {
+      int size = 24 + rand() % (std::min(im.cols, im.rows) / 2);
+      bbox.x1 = rand() % (im.cols - size);
+      bbox.y1 = rand() % (im.rows - size);
+      bbox.x2 = bbox.x1 + size;
+      bbox.y2 = bbox.y1 + size;
+    }
+    cout << count;
+    for (int batch_size : {1, 0}) {
+      mtcnn.batch_size = batch_size;
+      clock_t begin = clock();
+      for (int i = 0; i < ntimes; i++)
+        mtcnn.Refine(image, proposals);
+      clock_t end = clock();
+      cout << "\t" << (double)(end - begin) * 1000 / CLOCKS_PER_SEC / ntimes;
+    }
+    cout << endl;
+  }
+}
+
+bool same_bboxes(const vector<BBox> & a, const vector<BBox> & b)
+{
+  if (a.size() != b.size())
+    return false;
+  for (size_t i = 0; i < a.size(); i++) {
+    if (a[i].x1 != b[i].x1 || a[i].y1 != b[i].y1 || a[i].x2 != b[i].x2 || a[i].y2 != b[i].y2 ||
+      a[i].score != b[i].score || memcmp(a[i].fpoints, b[i].fpoints, sizeof(a[i].fpoints)) != 0)
+      return false;
+  }
+  return true;
+}
+
+#include <thread>
+#include <chrono>
+// Many threads share one detector, results must equal a single threaded run.
+void stress(int nthreads = 16, int ntimes = 20) {
+  Mtcnn mtcnn("../models");
+  Mat im = imread("../sample.jpg");
+  ncnn::Mat image = ncnn::Mat::from_pixels(im.data, ncnn::Mat::PIXEL_BGR, im.cols, im.rows);
+  vector<BBox> detected = mtcnn.Detect(image);
+  vector<BBox> refined = mtcnn.Refine(image, detected);
+  // concurrent calls also share the stage threads
+  mtcnn.num_threads = 4;
+  vector<int> mismatches(nthreads, 0);
+  vector<thread> workers;
+  auto begin = chrono::steady_clock::now();
+  for (int t = 0; t < nthreads; t++) {
+    // odd threads only run R/O/Lnet on the detected faces
+    workers.emplace_back([&, t]() {
+      for (int i = 0; i < ntimes; i++) {
+        if (t % 2 == 0)
+          mismatches[t] += !same_bboxes(mtcnn.Detect(image), detected);
+        else
+          mismatches[t] += !same_bboxes(mtcnn.Refine(image, detected), refined);
+      }
+    });
+  }
+  for (auto & worker : workers)
+    worker.join();
+  auto end = chrono::steady_clock::now();
+  int total = 0;
+  for (int m : mismatches)
+    total += m;
+  string disc_pad = "=============";
+  cout << disc_pad << " " << nthreads << " threads " << disc_pad << endl;
+  cout << "calls: " << nthreads * ntimes << ", mismatches: " << total << endl;
+  cout << "wall time: " << chrono::duration<double, milli>(end - begin).count() << " ms" << endl;
+}
+
+// Memory requests of temporaries per Detect call, heap ones drop to zero once warmed up.
+void image_batch_performance(const string & path = "../sample.jpg", int nimages = 16, int ntimes = 5) {
+  Mtcnn mtcnn("../models");
+  mtcnn.num_threads = std::max<int>(thread::hardware_concurrency(), 1);
+  mtcnn.batch_size = 0;
+  Mat im = imread(path);
+  // the same photo cropped differently, so images differ in size and faces
+  vector<Mat> ims;
+  vector<ImageView> images;
+  srand(0);
+  for (int i = 0; i < nimages; i++) {
+    int w = im.cols / 2 + rand() % (im.cols / 2), h = im.rows / 2 + rand() % (im.rows / 2);
+    ims.push_back(im(Rect(rand() % (im.cols - w + 1), rand() % (im.rows - h + 1), w, h)).clone());
+    images.emplace_back(ims[i].data, ims[i].cols, ims[i].rows, (int)ims[i].step[0]);
+  }
+  vector<vector<BBox>> single(nimages), batched;
+  auto t0 = chrono::steady_clock::now();
+  for (int n = 0; n < ntimes; n++)
+    for (int i = 0; i < nimages; i++)
+      single[i] = mtcnn.Detect(images[i]);
+  auto t1 = chrono::steady_clock::now();
+  for (int n = 0; n < ntimes; n++)
+    batched = mtcnn.DetectBatch(images);
+  auto t2 = chrono::steady_clock::now();
+  bool same = true;
+  for (int i = 0; i < nimages; i++)
+    same = same && same_bboxes(single[i], batched[i]);
+  string disc_pad = "=============";
+  cout << disc_pad << " image batch " << disc_pad << endl;
+  cout << "cpu info: " << cpu_info() << endl;
+  cout << "images: " << nimages << ", threads: " << mtcnn.num_threads << endl;
+  double one = chrono::duration<double>(t1 - t0).count(), all = chrono::duration<double>(t2 - t1).count();
+  cout << "one by one: " << nimages * ntimes / one << " images/s" << endl;
+  cout << "batch: " << nimages * ntimes / all << " images/s" << endl;
+  cout << "same faces: " << (same ? "yes" : "no") << endl;
+}
+
+// Frames of a stream through Detect one by one, then through the stage
+// pipeline with a capture thread pushing and this thread popping.
+void pipeline_performance(int nframes = 60, int pnet_workers = 2) {
+  Mtcnn mtcnn("../models");
+  Mat im = imread("../sample.jpg");
+  // sample panned a little each frame
+  int width = im.cols * 3 / 4, height = im.rows * 3 / 4;
+  vector<Mat> frames;
+  for (int i = 0; i < nframes; i++) {
+    int shift = i % 16;
+    frames.push_back(im(Rect(shift * (im.cols - width) / 16, shift * (im.rows - height) / 16,
+      width, height)).clone());
+  }
+  vector<vector<BBox>> single(nframes), piped(nframes);
+  auto t0 = chrono::steady_clock::now();
+  for (int i = 0; i < nframes; i++)
+    single[i] = mtcnn.Detect(ImageView(frames[i].data, width, height, (int)frames[i].step[0]));
+  auto t1 = chrono::steady_clock::now();
+  int workers[PipelineDetector::STAGE_COUNT] = {pnet_workers, 1, 1, 1};
+  PipelineDetector::Stats stats;
+  {
+    PipelineDetector pipeline(mtcnn, workers);
+    thread capture([&]() {
+      for (int i = 0; i < nframes; i++)
+        pipeline.Push(ImageView(frames[i].data, width, height, (int)frames[i].step[0]));
+      pipeline.Close();
+    });
+    for (int i = 0; pipeline.Pop(piped[i]); i++) {}
+    capture.join();
+    stats = pipeline.stats();
+  }
+  bool same = true;
+  for (int i = 0; i < nframes; i++)
+    same = same && same_bboxes(single[i], piped[i]);
+  double single_ms = chrono::duration<double, milli>(t1 - t0).count() / nframes;
+  string disc_pad = "=============";
+  cout << disc_pad << " stage pipeline " << disc_pad << endl;
+  cout << "cpu info: " << cpu_info() << endl;
+  cout << "frames: " << nframes << ", shape: (" << width << ", " << height << ")" << endl;
+  cout << "one by one: " << 1000 / single_ms << " fps, latency " << single_ms << " ms" << endl;
+  cout << "pipeline: " << stats.fps << " fps, latency " << stats.latency_ms << " ms" << endl;
+  cout << "stage\tworkers\tbusy (ms/frame)\toccupancy" << endl;
+  const char* names[PipelineDetector::STAGE_COUNT] = {"Pnet", "Rnet", "Onet", "Lnet"};
+  for (int s = 0; s < PipelineDetector::STAGE_COUNT; s++) {
+    const PipelineDetector::StageStats & stage = stats.stages[s];
+    cout << names[s] << "\t" << stage.workers << "\t" << stage.busy_ms / std::max<size_t>(stage.frames, 1)
+      << "\t" << stage.occupancy << endl;
+  }
+  cout << "same faces: " << (same ? "yes" : "no") << endl;
+}
+
+void memory_performance(int ntimes = 5) {
+  Mtcnn mtcnn("../models");
+  Mat im = imread("../sample.jpg");
+  ncnn::Mat image = ncnn::Mat::from_pixels(im.data, ncnn::Mat::PIXEL_BGR, im.cols, im.rows);
+  string disc_pad = "=============";
+  cout << disc_pad << " memory per frame " << disc_pad << endl;
+  cout << "frame\tallocs\tbytes\theap allocs\theap bytes" << endl;
+  for (int i = 0; i < ntimes; i++) {
+    mtcnn.Detect(image);
+    FrameAllocator::Stats stats = mtcnn.MemoryStats();
+    cout << i << "\t" << stats.allocs << "\t" << stats.bytes << "\t"
+      << stats.heap_allocs << "\t" << stats.heap_bytes << endl;
+  }
+}
+
+// Latency of one Detect call against num_threads, best run on a crowd image.
+void thread_performance(const string & path = "../sample.jpg", int ntimes = 20) {
+  Mtcnn mtcnn("../models");
+  Mat im = imread(path);
+  ncnn::Mat image = ncnn::Mat::from_pixels(im.data, ncnn::Mat::PIXEL_BGR, im.cols, im.rows);
+  int max_threads = std::max<int>(thread::hardware_concurrency(), 1);
+  string disc_pad = "=============";
+  cout << disc_pad << " stage threads " << disc_pad << endl;
+  cout << "cpu info: " << cpu_info() << endl;
+  cout << "image shape: (" << image.w << ", " << image.h << ", " << image.c << ")" << endl;
+  cout << "faces: " << mtcnn.Detect(image).size() << endl;
+  cout << "threads\tdetect time (ms)\tspeedup" << endl;
+  double base = 0;
+  for (int num_threads = 1; num_threads <= max_threads; num_threads++) {
+    mtcnn.num_threads = num_threads;
+    mtcnn.Detect(image);  // warm up workers and context
+    auto begin = chrono::steady_clock::now();
+    for (int i = 0; i < ntimes; i++)
+      mtcnn.Detect(image);
+    auto end = chrono::steady_clock::now();
+    double ms = chrono::duration<double, milli>(end - begin).count() / ntimes;
+    if (num_threads == 1)
+      base = ms;
+    cout << num_threads << "\t" << ms << "\t" << base / ms << endl;
+  }
+}
+
+// Average frame latency of full detect against VideoDetector on a stream.
+void video_performance(const string & path, int detect_interval = 10) {
+  VideoCapture cap(path);
+  if (!cap.isOpened()) {
+    cout << "can not open video: " << path << endl;
+    return;
+  }
+  Mtcnn mtcnn("../models");
+  VideoDetector detector(mtcnn);
+  detector.detect_interval = detect_interval;
+  Mat im;
+  int frames = 0, width = 0, height = 0;
+  double full_ms = 0, video_ms = 0;
+  while (cap.read(im)) {
+    ImageView image(im.data, im.cols, im.rows, (int)im.step[0]);
+    auto t0 = chrono::steady_clock::now();
+    mtcnn.Detect(image);
+    auto t1 = chrono::steady_clock::now();
+    detector.Detect(image);
+    auto t2 = chrono::steady_clock::now();
+    full_ms += chrono::duration<double, milli>(t1 - t0).count();
+    video_ms += chrono::duration<double, milli>(t2 - t1).count();
+    frames++;
+    width = im.cols;
+    height = im.rows;
+  }
+  if (frames == 0)
+    return;
+  string disc_pad = "=============";
+  cout << disc_pad << " video " << disc_pad << endl;
+  cout << "cpu info: " << cpu_info() << endl;
+  cout << "frames: " << frames << ", shape: (" << width << ", " << height << ")" << endl;
+  cout << "full detect: " << full_ms / frames << " ms/frame" << endl;
+  cout << "video detect: " << video_ms / frames << " ms/frame, interval " << detect_interval << endl;
+}
+
+// Synthetic NV21/I420 frames from sample: detect from YUV views must equal
+// detect from the frame converted by ncnn, without converting it.
+void yuv_performance(int ntimes = 20) {
+  Mtcnn mtcnn("../models");
+  Mat im = imread("../sample.jpg");
+  int width = im.cols & ~1, height = im.rows & ~1;
+  Mat i420;
+  cvtColor(im(Rect(0, 0, width, height)), i420, COLOR_BGR2YUV_I420);
+  // NV21: same Y plane, then V/U interleaved
+  vector<unsigned char> nv21(i420.data, i420.data + width * height * 3 / 2);
+  const unsigned char* u = i420.data + width * height;
+  const unsigned char* v = u + width * height / 4;
+  for (int i = 0; i < width * height / 4; i++) {
+    nv21[width * height + 2 * i] = v[i];
+    nv21[width * height + 2 * i + 1] = u[i];
+  }
+  vector<unsigned char> rgb(width * height * 3);
+  ncnn::yuv420sp2rgb(nv21.data(), width, height, rgb.data());
+  ncnn::Mat image = ncnn::Mat::from_pixels(rgb.data(), ncnn::Mat::PIXEL_RGB2BGR, width, height);
+  vector<BBox> ref = mtcnn.Detect(image);
+  string disc_pad = "=============";
+  cout << disc_pad << " yuv input " << disc_pad << endl;
+  cout << "cpu info: " << cpu_info() << endl;
+  cout << "image shape: (" << width << ", " << height << ")" << endl;
+  cout << "nv21 same: " << same_bboxes(mtcnn.Detect(ImageView(nv21.data(), width, height, width, PIXEL_NV21)), ref) << endl;
+  cout << "i420 same: " << same_bboxes(mtcnn.Detect(ImageView(i420.data, width, height, width, PIXEL_I420)), ref) << endl;
+  clock_t begin = clock();
+  for (int i = 0; i < ntimes; i++) {
+    ncnn::yuv420sp2rgb(nv21.data(), width, height, rgb.data());
+    mtcnn.Detect(ncnn::Mat::from_pixels(rgb.data(), ncnn::Mat::PIXEL_RGB2BGR, width, height));
+  }
+  clock_t middle = clock();
+  for (int i = 0; i < ntimes; i++)
+    mtcnn.Detect(ImageView(nv21.data(), width, height, width, PIXEL_NV21));
+  clock_t end = clock();
+  cout << "convert + detect time: " << (double)(middle - begin) * 1000 / CLOCKS_PER_SEC / ntimes << " ms" << endl;
+  cout << "nv21 detect time: " << (double)(end - middle) * 1000 / CLOCKS_PER_SEC / ntimes << " ms" << endl;
+}
+
+// Greedy nms erasing overlapped boxes from the sorted vector, the way
+// Mtcnn did it before NmsBoxes. Returns kept indices.
+vector<int> erase_nms(const vector<BBox> & bboxes, float threshold, bool min_overlap) {
+  vector<int> order(bboxes.size());
+  for (size_t i = 0; i < order.size(); i++)
+    order[i] = (int)i;
+  stable_sort(order.begin(), order.end(),
+    [&](int a, int b) { return bboxes[a].score > bboxes[b].score; });
+  for (size_t keep = 0; keep < order.size(); keep++) {
+    const BBox & m = bboxes[order[keep]];
+    for (size_t i = keep + 1; i < order.size(); ) {
+      const BBox & b = bboxes[order[i]];
+      int x1 = std::max(m.x1, b.x1), y1 = std::max(m.y1, b.y1);
+      int x2 = std::min(m.x2, b.x2), y2 = std::min(m.y2, b.y2);
+      float overlap = 0.f;
+      if (x1 < x2 && y1 < y2) {
+        int inter = (x2 - x1) * (y2 - y1);
+        int outer = min_overlap ? std::min(m.area(), b.area()) : m.area() + b.area() - inter;
+        overlap = static_cast<float>(inter) / outer;
+      }
+      if (overlap > threshold)
+        order.erase(order.begin() + i);
+      else
+        i++;
+    }
+  }
+  return order;
+}
+
+// Random clusters of boxes around faces, like Pnet candidates.
+// The erase loop is skipped above 10k candidates, it takes too long.
+void nms_performance(int ntimes = 10) {
+  string disc_pad = "=============";
+  cout << disc_pad << " nms " << disc_pad << endl;
+  cout << "cpu info: " << cpu_info() << endl;
+  cout << "candidates\terase (ms)\tbitmask (ms)\tgrid (ms)\tsame" << endl;
+  srand(0);
+  for (int count : {100, 1000, 10000, 50000}) {
+    vector<BBox> bboxes(count);
+    for (int i = 0; i < count; i++) {
+      BBox & bbox = bboxes[i];
+      int size = 12 + rand() % 200;
+      int cx = (i % 50) * 80 + rand() % 24;
+      int cy = (i % 37) * 60 + rand() % 24;
+      bbox.x1 = cx - size / 2;
+      bbox.y1 = cy - size / 2;
+      bbox.x2 = bbox.x1 + size;
+      bbox.y2 = bbox.y1 + size;
+      bbox.score = (float)rand() / RAND_MAX;
+    }
+    bool erase = count <= 10000;
+    bool same = true;
+    double ms[3] = { 0, 0, 0 };
+    for (bool min_overlap : {false, true}) {
+      vector<int> keeps[3];
+      for (int m = erase ? 0 : 1; m < 3; m++) {
+        auto begin = chrono::steady_clock::now();
+        for (int i = 0; i < ntimes; i++) {
+          if (m == 0) {
+            keeps[m] = erase_nms(bboxes, 0.5f, min_overlap);
+            continue;
+          }
+          NmsBoxes boxes;
+          for (const BBox & bbox : bboxes)
+            boxes.push_back(bbox.x1, bbox.y1, bbox.x2, bbox.y2, bbox.score);
+          keeps[m] = boxes.Suppress(0.5f, min_overlap, m == 1 ? NMS_BITMASK : NMS_GRID);
+        }
+        auto end = chrono::steady_clock::now();
+        ms[m] += chrono::duration<double, milli>(end - begin).count() / ntimes / 2;
+      }
+      same = same && keeps[2] == keeps[1] && (!erase || keeps[1] == keeps[0]);
+    }
+    cout << count << "\t";
+    if (erase)
+      cout << ms[0];
+    else
+      cout << "-";
+    cout << "\t" << ms[1] << "\t" << ms[2] << "\t" << same << endl;
+  }
+}
+
+// Largest face only against full detect, on frames of a single person.
+void largest_performance(const string & path = "../sample.jpg", int ntimes = 20) {
+  Mtcnn mtcnn("../models");
+  Mat im = imread(path);
+  ImageView image(im.data, im.cols, im.rows, (int)im.step[0]);
+  vector<BBox> all, largest;
+  auto t0 = chrono::steady_clock::now();
+  for (int i = 0; i < ntimes; i++)
+    all = mtcnn.Detect(image);
+  auto t1 = chrono::steady_clock::now();
+  for (int i = 0; i < ntimes; i++)
+    largest = mtcnn.DetectLargest(image, 1);
+  auto t2 = chrono::steady_clock::now();
+  string disc_pad = "=============";
+  cout << disc_pad << " largest face " << disc_pad << endl;
+  cout << "cpu info: " << cpu_info() << endl;
+  cout << "image shape: (" << im.cols << ", " << im.rows << ")" << endl;
+  cout << "full detect: " << chrono::duration<double, milli>(t1 - t0).count() / ntimes
+    << " ms, " << all.size() << " faces" << endl;
+  cout << "largest detect: " << chrono::duration<double, milli>(t2 - t1).count() / ntimes
+    << " ms, " << largest.size() << " faces" << endl;
+  if (!all.empty() && !largest.empty()) {
+    const BBox & a = *std::max_element(all.begin(), all.end(),
+      [](const BBox & x, const BBox & y) { return x.area() < y.area(); });
+    const BBox & b = largest[0];
+    cout << "largest of full: (" << a.x1 << ", " << a.y1 << ", " << a.x2 << ", " << a.y2 << ")" << endl;
+    cout << "largest detect: (" << b.x1 << ", " << b.y1 << ", " << b.x2 << ", " << b.y2 << ")" << endl;
+  }
+}
+
 #include <fstream>
 void fddb_detect(const string name = "mtcnn") {
   Mtcnn mtcnn("../models", false);
@@ -87,25 +541,602 @@ void fddb_detect(const string name = "mtcnn") {
   ofstream dets(fddb_root + "/dets/" + name + ".txt");
   string line;
   int cnt = 0;
-  while (getline(img_list, line)) {
-    cnt += 1;
-    cout << cnt << ": " << line << endl;
-    Mat im = imread(img_root + line + ".jpg");
-    ncnn::Mat image = ncnn::Mat::from_pixels(im.data, ncnn::Mat::PIXEL_BGR, im.cols, im.rows);
-    vector<BBox> bboxes = mtcnn.Detect(image);
-    dets << line << endl;
-    dets << bboxes.size() << endl;
-    for (auto & bbox : bboxes) {
-      dets << bbox.x1 << " " << bbox.y1 << " ";
-      dets << bbox.x2 - bbox.x1 << " " << bbox.y2 - bbox.y1 << " ";
-      dets << bbox.score << endl;
+  // images are detected batch by batch
+  const int batch = 16;
+  vector<string> lines;
+  vector<Mat> ims;
+  vector<ImageView> images;
+  bool more = true;
+  while (more) {
+    more = static_cast<bool>(getline(img_list, line));
+    if (more) {
+      cnt += 1;
+      cout << cnt << ": " << line << endl;
+      lines.push_back(line);
+      ims.push_back(imread(img_root + line + ".jpg"));
+      images.emplace_back(ims.back().data, ims.back().cols, ims.back().rows, (int)ims.back().step[0]);
+    }
+    if (static_cast<int>(lines.size()) < batch && more)
+      continue;
+    vector<vector<BBox>> batch_bboxes = mtcnn.DetectBatch(images);
+    for (size_t i = 0; i < lines.size(); i++) {
+      dets << lines[i] << endl;
+      dets << batch_bboxes[i].size() << endl;
+      for (auto & bbox : batch_bboxes[i]) {
+        dets << bbox.x1 << " " << bbox.y1 << " ";
+        dets << bbox.x2 - bbox.x1 << " " << bbox.y2 - bbox.y1 << " ";
+        dets << bbox.score << endl;
+      }
+    }
+    lines.clear();
+    ims.clear();
+    images.clear();
+  }
+}
+
+void roi_performance(const string & path = "../sample.jpg", int ntimes = 20) {
+  Mtcnn mtcnn("../models");
+  Mat im = imread(path);
+  ImageView image(im.data, im.cols, im.rows, (int)im.step[0]);
+  vector<BBox> all = mtcnn.Detect(image);
+  if (all.empty())
+    return;
+  // roi: largest face grown by half its size each side, mask: the same
+  const BBox & face = *std::max_element(all.begin(), all.end(),
+    [](const BBox & x, const BBox & y) { return x.area() < y.area(); });
+  int fw = face.x2 - face.x1, fh = face.y2 - face.y1;
+  vector<Roi> rois(1, Roi(face.x1 - fw / 2, face.y1 - fh / 2, face.x2 + fw / 2, face.y2 + fh / 2));
+  Mat mask_im = Mat::zeros(im.rows, im.cols, CV_8UC1);
+  rectangle(mask_im, Rect(rois[0].x1, rois[0].y1, rois[0].x2 - rois[0].x1, rois[0].y2 - rois[0].y1),
+    Scalar(255), -1);
+  ImageView mask(mask_im.data, mask_im.cols, mask_im.rows, (int)mask_im.step[0], PIXEL_GRAY);
+
+  vector<BBox> whole, in_roi, in_mask;
+  auto t0 = chrono::steady_clock::now();
+  for (int i = 0; i < ntimes; i++)
+    all = mtcnn.Detect(image);
+  auto t1 = chrono::steady_clock::now();
+  for (int i = 0; i < ntimes; i++)
+    in_roi = mtcnn.Detect(image, rois);
+  auto t2 = chrono::steady_clock::now();
+  for (int i = 0; i < ntimes; i++)
+    in_mask = mtcnn.Detect(image, mask);
+  auto t3 = chrono::steady_clock::now();
+  whole = mtcnn.Detect(image, vector<Roi>(1, Roi(0, 0, im.cols, im.rows)));
+  string disc_pad = "=============";
+  cout << disc_pad << " roi detect " << disc_pad << endl;
+  cout << "cpu info: " << cpu_info() << endl;
+  cout << "image shape: (" << im.cols << ", " << im.rows << ")" << endl;
+  cout << "roi: (" << rois[0].x1 << ", " << rois[0].y1 << ", " << rois[0].x2 << ", " << rois[0].y2 << ")" << endl;
+  cout << "full detect: " << chrono::duration<double, milli>(t1 - t0).count() / ntimes
+    << " ms, " << all.size() << " faces" << endl;
+  cout << "roi detect: " << chrono::duration<double, milli>(t2 - t1).count() / ntimes
+    << " ms, " << in_roi.size() << " faces" << endl;
+  cout << "mask detect: " << chrono::duration<double, milli>(t3 - t2).count() / ntimes
+    << " ms, " << in_mask.size() << " faces" << endl;
+  cout << "image roi same as full: " << (same_bboxes(whole, all) ? "yes" : "no") << endl;
+}
+// Square region of im warped to planar float size x size, as the detector
+// samples candidates.
+ncnn::Mat crop_input(const Mat & im, int x1, int y1, int x2, int y2, int size) {
+  static const int bgr[3] = {0, 1, 2};
+  ncnn::Mat input(size, size, 3);
+  WarpRoi(im.data, im.cols, im.rows, (int)im.step[0], 3, bgr, 3,
+    x1, y1, x2, y2, size, size, (float*)input.data, input.cstep);
+  return input;
+}
+
+// Int8 models from the float ones of ../models, written into out_dir which
+// must exist. Ranges are collected on the jpg images of image_dir: Pnet on
+// pyramid levels, R/Onet on crops around faces and random crops, Lnet on
+// patches around landmarks.
+void int8_calibrate(const string & image_dir = "../images", const string & out_dir = "../models_int8") {
+  Mtcnn mtcnn("../models");
+  const char* names[4] = {"det1", "det2", "det3", "det4"};
+  // params sharing the .bin of each model
+  const vector<string> params[4] = {
+    {"det1.param", "det1_head.param", "det1_mosaic.param"},
+    {"det2.param", "det2_batch.param"},
+    {"det3.param", "det3_batch.param"},
+    {"det4.param"}
+  };
+  Int8Calibrator calibrators[4];
+  for (int i = 0; i < 4; i++) {
+    if (calibrators[i].Load("../models", names[i]) != 0) {
+      cout << "can't load " << names[i] << endl;
+      return;
+    }
+  }
+  vector<String> paths;
+  glob(image_dir + "/*.jpg", paths);
+  srand(0);
+  for (const auto & path : paths) {
+    Mat im = imread(path);
+    if (im.empty())
+      continue;
+    cout << path << endl;
+    // Pnet: pyramid levels, scales as Detect makes them
+    int min_len = std::min(std::min(im.cols, im.rows), mtcnn.face_max_size);
+    for (float scale = 12.0f / mtcnn.face_min_size; scale >= 12.0f / min_len; scale *= mtcnn.scale_factor) {
+      int w = (int)ceil(im.cols * scale), h = (int)ceil(im.rows * scale);
+      calibrators[0].Add(ncnn::Mat::from_pixels_resize(im.data, ncnn::Mat::PIXEL_BGR, im.cols, im.rows, w, h));
+    }
+    // R/Onet: faces moved by up to a tenth of their size, and random crops
+    vector<BBox> faces = mtcnn.Detect(ImageView(im.data, im.cols, im.rows, (int)im.step[0]));
+    vector<Roi> crops;
+    for (const BBox & face : faces) {
+      int size = std::max(face.x2 - face.x1, face.y2 - face.y1);
+      crops.emplace_back(face.x1, face.y1, face.x1 + size, face.y1 + size);
+      for (int k = 0; k < 4; k++) {
+        int x = face.x1 + rand() % (size / 5 + 1) - size / 10;
+        int y = face.y1 + rand() % (size / 5 + 1) - size / 10;
+        crops.emplace_back(x, y, x + size, y + size);
+      }
+    }
+    for (int k = 0; k < 16; k++) {
+      int size = 12 + rand() % std::max(std::min(im.cols, im.rows) / 2 - 12, 1);
+      int x = rand() % (im.cols - size + 1), y = rand() % (im.rows - size + 1);
+      crops.emplace_back(x, y, x + size, y + size);
+    }
+    for (const Roi & crop : crops) {
+      calibrators[1].Add(crop_input(im, crop.x1, crop.y1, crop.x2, crop.y2, 24));
+      calibrators[2].Add(crop_input(im, crop.x1, crop.y1, crop.x2, crop.y2, 48));
+    }
+    // Lnet: patches around the 5 points, as Detect cuts them
+    for (const BBox & face : faces) {
+      int patchw = (int)(std::max(face.x2 - face.x1, face.y2 - face.y1) * 0.25f);
+      if (patchw % 2 == 1)
+        patchw += 1;
+      ncnn::Mat input(24, 24, 15);
+      for (int i = 0; i < 5; i++) {
+        int x1 = (int)face.fpoints[i] - patchw / 2;
+        int y1 = (int)face.fpoints[i+5] - patchw / 2;
+        ncnn::Mat patch = crop_input(im, x1, y1, x1 + patchw, y1 + patchw, 24);
+        for (int q = 0; q < 3; q++)
+          memcpy(input.channel(3 * i + q), patch.channel(q), 24 * 24 * sizeof(float));
+      }
+      calibrators[3].Add(input);
+    }
+  }
+  for (int i = 0; i < 4; i++) {
+    if (calibrators[i].Save(out_dir, params[i]) != 0)
+      cout << "can't write " << names[i] << " into " << out_dir << endl;
+  }
+}
+
+float iou(const BBox & a, const BBox & b) {
+  int w = std::min(a.x2, b.x2) - std::max(a.x1, b.x1);
+  int h = std::min(a.y2, b.y2) - std::max(a.y1, b.y1);
+  if (w <= 0 || h <= 0)
+    return 0;
+  return (float)(w * h) / (a.area() + b.area() - w * h);
+}
+
+// Accuracy gate of converted models of model_dir, e.g. by int8_calibrate
+// or fp16_convert, against the float ones of ../models on the jpg images
+// of image_dir. Each float face is matched to the face of largest IoU, 0.5
+// or more, not matched yet. Fails if the face count changes by more than
+// max_count_delta of the float count, or matched boxes have a mean IoU
+// below min_iou.
+bool model_accuracy(const string & model_dir = "../models_int8", const string & image_dir = "../images",
+  float max_count_delta = 0.05f, float min_iou = 0.9f) {
+  Mtcnn float_mtcnn("../models");
+  Mtcnn model_mtcnn(model_dir);
+  vector<String> paths;
+  glob(image_dir + "/*.jpg", paths);
+  size_t float_faces = 0, model_faces = 0, matched = 0;
+  double iou_sum = 0, float_ms = 0, model_ms = 0;
+  for (const auto & path : paths) {
+    Mat im = imread(path);
+    if (im.empty())
+      continue;
+    ImageView image(im.data, im.cols, im.rows, (int)im.step[0]);
+    auto t0 = chrono::steady_clock::now();
+    vector<BBox> a = float_mtcnn.Detect(image);
+    auto t1 = chrono::steady_clock::now();
+    vector<BBox> b = model_mtcnn.Detect(image);
+    auto t2 = chrono::steady_clock::now();
+    float_ms += chrono::duration<double, milli>(t1 - t0).count();
+    model_ms += chrono::duration<double, milli>(t2 - t1).count();
+    float_faces += a.size();
+    model_faces += b.size();
+    vector<bool> used(b.size(), false);
+    for (const BBox & face : a) {
+      int best = -1;
+      float best_iou = 0.5f;
+      for (size_t j = 0; j < b.size(); j++) {
+        float o = iou(face, b[j]);
+        if (!used[j] && o >= best_iou) {
+          best = (int)j;
+          best_iou = o;
+        }
+      }
+      if (best >= 0) {
+        used[best] = true;
+        matched++;
+        iou_sum += best_iou;
+      }
+    }
+  }
+  double count_delta = float_faces > 0 ? ((double)model_faces - float_faces) / float_faces : 0;
+  double mean_iou = matched > 0 ? iou_sum / matched : 1;
+  bool pass = fabs(count_delta) <= max_count_delta && mean_iou >= min_iou;
+  string disc_pad = "=============";
+  cout << disc_pad << " " << model_dir << " accuracy " << disc_pad << endl;
+  cout << "cpu info: " << cpu_info() << endl;
+  cout << "images: " << paths.size() << endl;
+  cout << "faces float: " << float_faces << ", model: " << model_faces
+    << ", delta: " << count_delta * 100 << " %" << endl;
+  cout << "matched: " << matched << ", missed: " << float_faces - matched
+    << ", extra: " << model_faces - matched << endl;
+  cout << "mean IoU of matched: " << mean_iou << ", delta: " << 1 - mean_iou << endl;
+  cout << "float detect time: " << float_ms / std::max<size_t>(paths.size(), 1) << " ms" << endl;
+  cout << "model detect time: " << model_ms / std::max<size_t>(paths.size(), 1) << " ms" << endl;
+  cout << "gate: " << (pass ? "pass" : "fail") << endl;
+  return pass;
+}
+
+// Float16 models from the float ones of ../models, written into out_dir
+// which must exist. With keep_half fc layers keep float16 weights in
+// memory, else all weights are expanded to float at load.
+void fp16_convert(const string & out_dir = "../models_fp16", bool keep_half = false) {
+  const char* names[4] = {"det1", "det2", "det3", "det4"};
+  const vector<string> params[4] = {
+    {"det1.param", "det1_head.param", "det1_mosaic.param"},
+    {"det2.param", "det2_batch.param"},
+    {"det3.param", "det3_batch.param"},
+    {"det4.param"}
+  };
+  for (int i = 0; i < 4; i++) {
+    if (SaveHalfModel("../models", names[i], params[i], out_dir, keep_half) != 0)
+      cout << "can't convert " << names[i] << " into " << out_dir << endl;
+  }
+}
+
+// Pnet conv1-conv3 with PReLU and pool1 on levels of common frame sizes:
+// stock ncnn layers of det1.param against the ConvPReLU kernels of
+// det1_head.param, with the largest difference of their outputs.
+void conv_performance(int ntimes = 20) {
+  string disc_pad = "=============";
+  cout << disc_pad << " Pnet conv " << disc_pad << endl;
+  cout << "cpu info: " << cpu_info() << endl;
+  cout << "kernels: " << GetKernels().name << endl;
+  ncnn::Net stock, fused;
+  stock.load_param("../models/det1.param");
+  stock.load_model("../models/det1.bin");
+  RegisterCustomLayers(fused);
+  fused.load_param("../models/det1_head.param");
+  fused.load_model("../models/det1.bin");
+  cout << "level\tstock (ms)\tConvPReLU (ms)\tspeedup\tmax diff" << endl;
+  int sizes[3][2] = {{640, 480}, {1280, 720}, {1920, 1080}};
+  for (const auto & size : sizes) {
+    ncnn::Mat data(size[0], size[1], 3);
+    srand(0);
+    for (int q = 0; q < data.c; q++) {
+      float* ptr = data.channel(q);
+      for (int i = 0; i < data.w * data.h; i++)
+        ptr[i] = static_cast<float>(rand() % 256);
+    }
+    ncnn::Mat outputs[2];
+    double times[2];
+    for (int k = 0; k < 2; k++) {
+      auto begin = chrono::steady_clock::now();
+      for (int i = 0; i < ntimes; i++) {
+        ncnn::Extractor ex = (k == 0 ? stock : fused).create_extractor();
+        ex.set_light_mode(true);
+        if (k == 0) {
+          ex.input("data", data);
+          ex.extract("conv3_prelu3", outputs[k]);
+        } else {
+          ex.input(det1_head_param_id::BLOB_data, data);
+          ex.extract(det1_head_param_id::BLOB_conv3_prelu3, outputs[k]);
+        }
+      }
+      auto end = chrono::steady_clock::now();
+      times[k] = chrono::duration<double, milli>(end - begin).count() / ntimes;
+    }
+    float max_diff = 0;
+    for (int q = 0; q < outputs[0].c; q++) {
+      const float* a = outputs[0].channel(q);
+      const float* b = outputs[1].channel(q);
+      for (int i = 0; i < outputs[0].w * outputs[0].h; i++)
+        max_diff = std::max(max_diff, fabsf(a[i] - b[i]));
     }
+    cout << size[0] << "x" << size[1] << "\t" << times[0] << "\t" << times[1] << "\t"
+      << times[0] / times[1] << "\t" << max_diff << endl;
   }
 }
 
-int main() {
+// Each variant of the detector kernels this CPU runs, on the work of a
+// 1280x720 frame: conv2 of Pnet on its first level, the candidate scan of
+// its head over the same input, a resize row by row, and bitmask NMS of
+// 10000 boxes, with the largest difference from the baseline.
+void kernels_performance(int ntimes = 20) {
+  string disc_pad = "=============";
+  cout << disc_pad << " kernels " << disc_pad << endl;
+  cout << "cpu info: " << cpu_info() << endl;
+  const int w = 638, h = 358, channels = 10, num_output = 16;
+  srand(0);
+  vector<float> input(channels * w * h), weights(num_output * channels * 9);
+  for (float & v : input)
+    v = (float)rand() / RAND_MAX - 0.5f;
+  for (float & v : weights)
+    v = (float)rand() / RAND_MAX - 0.5f;
+  ncnn::Mat packed = PackConv3x3(ncnn::Mat(channels * 9 * num_output, weights.data()),
+    num_output, channels);
+  vector<float> bias(kConv3x3Block, 0.1f), slope(kConv3x3Block, 0.25f);
+  vector<int> x1s(10000 + kKernelPad), y1s(x1s.size()), x2s(x1s.size()), y2s(x1s.size()),
+    areas(x1s.size());
+  for (int i = 0; i < 10000; i++) {
+    int size = 12 + rand() % 200;
+    x1s[i] = (i % 50) * 80 + rand() % 24;
+    y1s[i] = (i % 37) * 60 + rand() % 24;
+    x2s[i] = x1s[i] + size;
+    y2s[i] = y1s[i] + size;
+    areas[i] = size * size;
+  }
+
+  cout << "variant	conv (ms)	scan (ms)	lerp (ms)	nms (ms)	max diff" << endl;
+  vector<float> base_out;
+  for (int isa = ISA_BASELINE; isa <= CpuIsa(); isa++) {
+    const Kernels* kernels = KernelsFor(static_cast<Isa>(isa));
+    if (!kernels)
+      continue;
+    vector<float> out(num_output * (w - 2) * (h - 2));
+    vector<float> l0(w * h), l1(w * h), lerp(w);
+    vector<int> cells(w * h);
+    vector<uint64_t> suppressed((x1s.size() + 63) / 64);
+    double ms[4] = { 0, 0, 0, 0 };
+    for (int n = 0; n < ntimes; n++) {
+      auto t0 = chrono::steady_clock::now();
+      vector<const float*> in(channels);
+      for (int b = 0; b < num_output / kConv3x3Block; b++) {
+        const float* kernel = (const float*)packed + b * channels * 9 * kConv3x3Block;
+        for (int y = 0; y < h - 2; y++) {
+          float* rows[kConv3x3Block];
+          for (int i = 0; i < kConv3x3Block; i++)
+            rows[i] = &out[((b * kConv3x3Block + i) * (h - 2) + y) * (w - 2)];
+          for (int q = 0; q < channels; q++)
+            in[q] = &input[(q * h + y) * w];
+          kernels->conv3x3_row(in.data(), channels, w, w - 2, kernel, bias.data(),
+            slope.data(), rows);
+        }
+      }
+      auto t1 = chrono::steady_clock::now();
+      kernels->logits2(input.data(), w * h, channels, w * h, &weights[0], &weights[channels],
+        0.f, 0.f, l0.data(), l1.data());
+      kernels->scan_margin(l0.data(), l1.data(), w * h, 1.f, cells.data());
+      auto t2 = chrono::steady_clock::now();
+      for (int y = 0; y < h; y++)
+        kernels->lerp_rows(&input[y * w], &input[(h - 1 - y) * w], 0.25f, 0.75f, w,
+          lerp.data());
+      auto t3 = chrono::steady_clock::now();
+      std::fill(suppressed.begin(), suppressed.end(), 0);
+      for (int i = 0; i < 10000; i += 10)
+        kernels->suppress_all(x1s.data(), y1s.data(), x2s.data(), y2s.data(), areas.data(),
+          i, 10000, 0.5f, false, suppressed.data());
+      auto t4 = chrono::steady_clock::now();
+      ms[0] += chrono::duration<double, milli>(t1 - t0).count() / ntimes;
+      ms[1] += chrono::duration<double, milli>(t2 - t1).count() / ntimes;
+      ms[2] += chrono::duration<double, milli>(t3 - t2).count() / ntimes;
+      ms[3] += chrono::duration<double, milli>(t4 - t3).count() / ntimes;
+    }
+    if (base_out.empty())
+      base_out = out;
+    float max_diff = 0;
+    for (size_t i = 0; i < out.size(); i++)
+      max_diff = std::max(max_diff, fabsf(out[i] - base_out[i]));
+    cout << kernels->name << "\t" << ms[0] << "\t" << ms[1] << "\t" << ms[2] << "\t"
+      << ms[3] << "\t" << max_diff << endl;
+  }
+}
+
+// Instruction set of the detector kernels: what the CPU has, the variants
+// built in, and the one GetKernels runs.
+void print_isa() {
+  cout << "cpu: " << IsaName(CpuIsa()) << endl;
+  cout << "built:";
+  for (int isa = ISA_BASELINE; isa < ISA_COUNT; isa++) {
+    const Kernels* kernels = KernelsFor(static_cast<Isa>(isa));
+    if (kernels)
+      cout << " " << kernels->name;
+  }
+  cout << endl;
+  const char* cap = getenv("MTCNN_ISA");
+  cout << "active: " << GetKernels().name;
+  if (cap)
+    cout << " (MTCNN_ISA=" << cap << ")";
+  cout << endl;
+}
+
+// Binary params of model_dir, which Mtcnn loads when present, and the
+// header of their blob indices it is compiled with. Copies written by
+// int8_calibrate and fp16_convert get binary params already, with the same
+// blobs.
+void param_to_bin(const string & model_dir = "../models",
+  const string & header = "../src/model_ids.h") {
+  vector<string> params = {"det1_head", "det1_mosaic", "det2", "det2_batch",
+    "det3", "det3_batch", "det4"};
+  vector<pair<string, vector<string>>> blobs;
+  for (const string & param : params) {
+    string path = model_dir + "/" + param + ".param";
+    blobs.emplace_back(param, vector<string>());
+    if (ModelFile::SaveParamBin(path, path + ".bin", &blobs.back().second) != 0)
+      cout << "can't convert " << path << endl;
+  }
+  if (ModelFile::SaveBlobIds(header, blobs) != 0)
+    cout << "can't write " << header << endl;
+}
+
+// Resident memory added by loading the models of each directory, and
+// detect time, e.g. float, float16 expanded at load and float16 kept half
+// from fp16_convert. Detectors stay loaded, so none reuses memory freed by
+// another.
+void model_memory_performance(const vector<string> & model_dirs =
+  {"../models", "../models_fp16", "../models_fp16_half"}, int ntimes = 20) {
+  Mat im = imread("../sample.jpg");
+  ImageView image(im.data, im.cols, im.rows, (int)im.step[0]);
+  string disc_pad = "=============";
+  cout << disc_pad << " model memory " << disc_pad << endl;
+  cout << "cpu info: " << cpu_info() << endl;
+  cout << "models\tresident (KB)\tdetect time (ms)\tfaces" << endl;
+  vector<unique_ptr<Mtcnn>> detectors;
+  for (const string & model_dir : model_dirs) {
+    size_t before = resident_memory();
+    detectors.emplace_back(new Mtcnn(model_dir));
+    size_t after = resident_memory();
+    Mtcnn & mtcnn = *detectors.back();
+    size_t faces = mtcnn.Detect(image).size();
+    auto begin = chrono::steady_clock::now();
+    for (int i = 0; i < ntimes; i++)
+      mtcnn.Detect(image);
+    auto end = chrono::steady_clock::now();
+    cout << model_dir << "\t" << (after - before) / 1024 << "\t"
+      << chrono::duration<double, milli>(end - begin).count() / ntimes << "\t" << faces << endl;
+  }
+}
+
+#ifndef _MSC_VER
+#include <sys/wait.h>
+// Resident, file-backed shared and proportional set sizes of the process in
+// KB, the last from smaps_rollup where the kernel has it.
+void process_memory(size_t & rss, size_t & shared, size_t & pss)
+{
+  ifstream statm("/proc/self/statm");
+  size_t pages = 0;
+  rss = shared = pss = 0;
+  statm >> pages >> rss >> shared;
+  size_t page_kb = sysconf(_SC_PAGESIZE) / 1024;
+  rss *= page_kb;
+  shared *= page_kb;
+  ifstream rollup("/proc/self/smaps_rollup");
+  string line;
+  while (getline(rollup, line)) {
+    if (line.compare(0, 4, "Pss:") == 0)
+      pss = stoul(line.substr(4));
+  }
+}
+
+// Per-process memory of n detector processes loading model_dir at once,
+// with weights read into heap against mapped and shared. Each process loads
+// and runs one detect, then holds until all have measured, so mapped pages
+// are shared while PSS is taken. Private is RSS less file-backed pages.
+void model_sharing_performance(const string & model_dir = "../models",
+  const vector<int> & process_counts = {1, 8, 32}) {
+  Mat im = imread("../sample.jpg");
+  string disc_pad = "=============";
+  cout << disc_pad << " model sharing " << disc_pad << endl;
+  cout << "cpu info: " << cpu_info() << endl;
+  cout << "models\tprocesses\trss (KB)\tshared (KB)\tprivate (KB)\tpss (KB)" << endl;
+  for (bool map_models : {false, true}) {
+    for (int n : process_counts) {
+      int results[2], hold[2];
+      if (pipe(results) != 0 || pipe(hold) != 0)
+        return;
+      vector<pid_t> children;
+      for (int i = 0; i < n; i++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+          close(results[0]);
+          close(hold[1]);
+          {
+            Mtcnn mtcnn(model_dir, true, map_models);
+            mtcnn.Detect(ImageView(im.data, im.cols, im.rows, (int)im.step[0]));
+            size_t memory[3];
+            process_memory(memory[0], memory[1], memory[2]);
+            ssize_t written = write(results[1], memory, sizeof(memory));
+            char c;
+            // returns once the parent closes hold
+            ssize_t held = read(hold[0], &c, 1);
+            (void)written;
+            (void)held;
+          }
+          _exit(0);
+        }
+        if (pid > 0)
+          children.push_back(pid);
+      }
+      close(results[1]);
+      close(hold[0]);
+      size_t total[3] = {0, 0, 0}, memory[3];
+      int count = 0;
+      while (count < (int)children.size() && read(results[0], memory, sizeof(memory)) == sizeof(memory)) {
+        for (int k = 0; k < 3; k++)
+          total[k] += memory[k];
+        count++;
+      }
+      close(hold[1]);
+      close(results[0]);
+      for (pid_t pid : children)
+        waitpid(pid, NULL, 0);
+      if (count == 0)
+        continue;
+      cout << (map_models ? "mapped" : "heap") << "\t" << count << "\t" << total[0] / count
+        << "\t" << total[1] / count << "\t" << (total[0] - total[1]) / count << "\t"
+        << total[2] / count << endl;
+    }
+  }
+}
+#endif
+
+// Time to construct a detector from model files against from the models
+// compiled in by MTCNN_EMBED_MODELS, first run and average.
+void startup_performance(int ntimes = 20) {
+  string disc_pad = "=============";
+  cout << disc_pad << " startup " << disc_pad << endl;
+  cout << "cpu info: " << cpu_info() << endl;
+  cout << "models\tfirst (ms)\tmean (ms)" << endl;
+  vector<string> sources = {"../models"};
+#ifdef MTCNN_EMBED_MODELS
+  sources.push_back("");
+#else
+  cout << "built without MTCNN_EMBED_MODELS, files only" << endl;
+#endif
+  for (const string & model_dir : sources) {
+    double first = 0, total = 0;
+    for (int i = 0; i < ntimes; i++) {
+      auto begin = chrono::steady_clock::now();
+      Mtcnn mtcnn(model_dir);
+      double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - begin).count();
+      if (i == 0)
+        first = ms;
+      total += ms;
+    }
+    cout << (model_dir.empty() ? "embedded" : model_dir) << "\t" << first << "\t" << total / ntimes << endl;
+  }
+}
+
+int main(int argc, char** argv) {
+  if (argc > 1 && string(argv[1]) == "--print-isa") {
+    print_isa();
+    return 0;
+  }
   //performance(true);
   //performance(false);
+  //batch_performance();
+  //image_batch_performance();
+  //pixel_performance();
+  //yuv_performance();
+  //nms_performance();
+  //largest_performance();
+  //roi_performance();
+  //memory_performance();
+  //stress();
+  //thread_performance();
+  //video_performance("../video.mp4");
+  //pipeline_performance();
+  //int8_calibrate();
+  //model_accuracy("../models_int8");
+  //fp16_convert("../models_fp16");
+  //fp16_convert("../models_fp16_half", true);
+  //param_to_bin();
+  //model_accuracy("../models_fp16");
+  //model_accuracy("../models_fp16_half");
+  //model_memory_performance();
+  //startup_performance();
+  //model_sharing_performance();
+  //conv_performance();
+  //kernels_performance();
   //fddb_detect();
   demo();
   return 0;
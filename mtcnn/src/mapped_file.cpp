@@ -0,0 +1,78 @@
+#include "mapped_file.h"
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+using namespace std;
+using namespace face;
+
+MappedFile::~MappedFile()
+{
+  Close();
+}
+
+#ifdef _WIN32
+int MappedFile::Open(const string & path)
+{
+  Close();
+  HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+    OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE)
+    return -1;
+  LARGE_INTEGER file_size;
+  HANDLE mapping = NULL;
+  if (GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0)
+    mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  // the view keeps the mapping open
+  CloseHandle(file);
+  if (!mapping)
+    return -1;
+  void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  CloseHandle(mapping);
+  if (!view)
+    return -1;
+  addr = static_cast<const unsigned char*>(view);
+  length = static_cast<size_t>(file_size.QuadPart);
+  return 0;
+}
+
+void MappedFile::Close()
+{
+  if (addr)
+    UnmapViewOfFile(addr);
+  addr = nullptr;
+  length = 0;
+}
+#else
+int MappedFile::Open(const string & path)
+{
+  Close();
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return -1;
+  struct stat st;
+  void* view = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size > 0)
+    view = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  // the mapping keeps the file open
+  close(fd);
+  if (view == MAP_FAILED)
+    return -1;
+  addr = static_cast<const unsigned char*>(view);
+  length = static_cast<size_t>(st.st_size);
+  return 0;
+}
+
+void MappedFile::Close()
+{
+  if (addr)
+    munmap(const_cast<unsigned char*>(addr), length);
+  addr = nullptr;
+  length = 0;
+}
+#endif
@@ -0,0 +1,36 @@
+#ifndef FACE_MAPPED_FILE_H_
+#define FACE_MAPPED_FILE_H_
+
+#include <string>
+
+namespace face
+{
+// Read-only, page-aligned mapping of a whole file. Pages are backed by the
+// file, so processes mapping the same model share one physical copy, and
+// only the pages touched are read in. ncnn Net::load_model(const unsigned
+// char*) references float and int8 weights of a mapped .bin in place;
+// float16 ones are expanded into heap as from files.
+class MappedFile
+{
+public:
+  MappedFile() {}
+  ~MappedFile();
+  MappedFile(const MappedFile &) = delete;
+  MappedFile & operator=(const MappedFile &) = delete;
+
+  /// @brief Map path, unmapping the file mapped before.
+  /// @return 0 on success, -1 if path can't be opened or mapped.
+  int Open(const std::string & path);
+  void Close();
+  /// @brief First byte of the mapping, null if none.
+  const unsigned char* data() const { return addr; }
+  size_t size() const { return length; }
+
+private:
+  const unsigned char* addr = nullptr;
+  size_t length = 0;
+};
+
+} // namespace face
+
+#endif // FACE_MAPPED_FILE_H_
@@ -0,0 +1,273 @@
+#include <cctype>     // isalnum
+#include <cstdlib>    // atoi, atof
+#include <cstring>    // strpbrk, memcpy
+#include <fstream>
+#include <sstream>
+
+#include "model_file.h"
+#include "layers.h"
+// ncnn
+#include "layer_type.h"
+using namespace std;
+using namespace face;
+
+static bool ReadFloats(FILE* fp, int n, vector<float> & data)
+{
+  data.resize(n);
+  return fread(data.data(), sizeof(float), n, fp) == static_cast<size_t>(n);
+}
+
+// Weights of a layer: 4 bytes of flag, 0 for raw float32, then the data.
+static bool ReadWeights(FILE* fp, int n, vector<float> & weights)
+{
+  unsigned int flag = 1;
+  if (fread(&flag, sizeof(flag), 1, fp) != 1 || flag != 0)
+    return false;
+  return ReadFloats(fp, n, weights);
+}
+
+void ModelFile::WriteFloats(FILE* fp, const vector<float> & data)
+{
+  fwrite(data.data(), sizeof(float), data.size(), fp);
+}
+
+bool ModelFile::ReadParam(const string & path, vector<string> & lines)
+{
+  ifstream file(path);
+  if (!file)
+    return false;
+  string line;
+  while (getline(file, line)) {
+    // ending blanks, and \r of files saved on Windows
+    line.erase(line.find_last_not_of(" \t\r") + 1);
+    lines.push_back(line);
+  }
+  return lines.size() >= 2;
+}
+
+bool ModelFile::ParseLine(const string & line, ModelFile::Layer & layer)
+{
+  istringstream tokens(line);
+  int nbottom = 0, ntop = 0;
+  if (!(tokens >> layer.type >> layer.name >> nbottom >> ntop))
+    return false;
+  layer.bottoms.resize(nbottom);
+  layer.tops.resize(ntop);
+  for (auto & bottom : layer.bottoms)
+    tokens >> bottom;
+  for (auto & top : layer.tops)
+    tokens >> top;
+  // arrays have negative keys and are not needed
+  string param;
+  while (tokens >> param) {
+    size_t eq = param.find('=');
+    if (eq != string::npos && param[0] != '-')
+      layer.params[atoi(param.substr(0, eq).c_str())] = atoi(param.substr(eq + 1).c_str());
+  }
+  layer.num_output = layer.params[0];
+  if (layer.type == "Convolution")
+    layer.bias = layer.params[5] != 0;
+  else if (layer.type == "InnerProduct")
+    layer.bias = layer.params[1] != 0;
+  return true;
+}
+
+int ModelFile::Load(const string & model_dir, const string & name)
+{
+  this->model_dir = model_dir;
+  this->name = name;
+  layers.clear();
+  vector<string> lines;
+  if (!ReadParam(model_dir + "/" + name + ".param", lines))
+    return -1;
+  FILE* fp = fopen((model_dir + "/" + name + ".bin").c_str(), "rb");
+  if (!fp)
+    return -1;
+  bool ok = true;
+  for (size_t i = 2; i < lines.size() && ok; i++) {
+    Layer layer;
+    if (!ParseLine(lines[i], layer))
+      continue;
+    if (layer.type == "Convolution")
+      ok = ReadWeights(fp, layer.params[6], layer.weights);
+    else if (layer.type == "InnerProduct")
+      ok = ReadWeights(fp, layer.params[2], layer.weights);
+    else if (layer.type == "PReLU")
+      ok = ReadFloats(fp, layer.num_output, layer.slopes);
+    else if (layer.type == "BatchNorm" || layer.type == "Scale" ||
+      layer.type == "Bias" || layer.type == "Deconvolution" ||
+      layer.type == "ConvolutionDepthWise" || layer.type == "MemoryData")
+      ok = false;
+    if (ok && layer.bias)
+      ok = ReadFloats(fp, layer.num_output, layer.bias_data);
+    layers.push_back(layer);
+  }
+  fclose(fp);
+  return ok ? 0 : -1;
+}
+
+bool ModelFile::Hidden(const ModelFile::Layer & layer) const
+{
+  if (layer.tops.empty())
+    return false;
+  string blob = layer.tops[0];
+  for (;;) {
+    const Layer* next = 0;
+    for (const Layer & other : layers) {
+      if (!other.bottoms.empty() && other.bottoms[0] == blob) {
+        next = &other;
+        break;
+      }
+    }
+    if (!next || next->tops.empty())
+      return false;
+    if (next->type == "PReLU")
+      return true;
+    if (next->type != "Dropout")
+      return false;
+    blob = next->tops[0];
+  }
+}
+
+int ModelFile::CopyParams(const string & model_dir, const string & out_dir,
+  const vector<string> & params,
+  const function<void(const ModelFile::Layer & layer, string & line)> & edit)
+{
+  for (const string & param : params) {
+    vector<string> lines;
+    if (!ReadParam(model_dir + "/" + param, lines))
+      return -1;
+    ofstream file(out_dir + "/" + param);
+    if (!file)
+      return -1;
+    for (size_t i = 0; i < lines.size(); i++) {
+      Layer layer;
+      if (i >= 2 && ParseLine(lines[i], layer))
+        edit(layer, lines[i]);
+      file << lines[i] << "\n";
+    }
+    file.close();
+    if (!file)
+      return -1;
+    if (SaveParamBin(out_dir + "/" + param, out_dir + "/" + param + ".bin") != 0)
+      return -1;
+  }
+  return 0;
+}
+
+// 4 bytes of a text param value, float if it reads as one, as ncnn does.
+static int ParamWord(const string & value)
+{
+  if (!strpbrk(value.c_str(), ".eE"))
+    return atoi(value.c_str());
+  float f = static_cast<float>(atof(value.c_str()));
+  int word;
+  memcpy(&word, &f, sizeof(word));
+  return word;
+}
+
+int ModelFile::SaveParamBin(const string & param_path, const string & out_path,
+  vector<string>* blobs)
+{
+  vector<string> lines;
+  if (!ReadParam(param_path, lines))
+    return -1;
+  vector<int> words;
+  int layer_count = 0, blob_count = 0;
+  istringstream counts(lines[1]);
+  counts >> layer_count >> blob_count;
+  words.push_back(atoi(lines[0].c_str()));
+  words.push_back(layer_count);
+  words.push_back(blob_count);
+  map<string, int> indices;
+  vector<string> names;
+  for (size_t i = 2; i < lines.size(); i++) {
+    istringstream tokens(lines[i]);
+    string type, name;
+    int nbottom = 0, ntop = 0;
+    if (!(tokens >> type >> name >> nbottom >> ntop))
+      continue;
+    int typeindex = ncnn::layer_to_index(type.c_str());
+    for (int c = 0; c < CUSTOM_LAYER_COUNT && typeindex < 0; c++) {
+      if (type == CustomLayerType(c))
+        typeindex = ncnn::LayerType::CustomBit | c;
+    }
+    if (typeindex < 0)
+      return -1;
+    words.push_back(typeindex);
+    words.push_back(nbottom);
+    words.push_back(ntop);
+    string blob;
+    for (int j = 0; j < nbottom; j++) {
+      tokens >> blob;
+      if (!indices.count(blob))
+        return -1;
+      words.push_back(indices[blob]);
+    }
+    // tops numbered in order of appearance
+    for (int j = 0; j < ntop; j++) {
+      tokens >> blob;
+      indices[blob] = static_cast<int>(names.size());
+      words.push_back(indices[blob]);
+      names.push_back(blob);
+    }
+    // id=value, arrays -23300-id=count,values..., then -233
+    string param;
+    while (tokens >> param) {
+      size_t eq = param.find('=');
+      if (eq == string::npos)
+        return -1;
+      int id = atoi(param.substr(0, eq).c_str());
+      string value = param.substr(eq + 1);
+      words.push_back(id);
+      if (id > -23300) {
+        words.push_back(ParamWord(value));
+        continue;
+      }
+      istringstream items(value);
+      string item;
+      while (getline(items, item, ','))
+        words.push_back(ParamWord(item));
+    }
+    words.push_back(-233);
+  }
+  FILE* fp = fopen(out_path.c_str(), "wb");
+  if (!fp)
+    return -1;
+  fwrite(words.data(), sizeof(int), words.size(), fp);
+  bool ok = ferror(fp) == 0;
+  fclose(fp);
+  if (blobs)
+    blobs->swap(names);
+  return ok ? 0 : -1;
+}
+
+// name as a C++ identifier, e.g. fc5-2 as fc5_2
+static string Identifier(const string & name)
+{
+  string id = name;
+  for (char & c : id) {
+    if (!isalnum(static_cast<unsigned char>(c)))
+      c = '_';
+  }
+  return id;
+}
+
+int ModelFile::SaveBlobIds(const string & header_path,
+  const vector<pair<string, vector<string>>> & params)
+{
+  ofstream file(header_path);
+  if (!file)
+    return -1;
+  file << "// generated from models by ModelFile::SaveBlobIds, do not edit\n";
+  file << "#ifndef FACE_MODEL_IDS_H_\n#define FACE_MODEL_IDS_H_\n\n";
+  file << "namespace face\n{\n";
+  for (const auto & param : params) {
+    file << "namespace " << Identifier(param.first) << "_param_id {\n";
+    for (size_t i = 0; i < param.second.size(); i++)
+      file << "const int BLOB_" << Identifier(param.second[i]) << " = " << i << ";\n";
+    file << "} // namespace " << Identifier(param.first) << "_param_id\n\n";
+  }
+  file << "} // namespace face\n\n#endif // FACE_MODEL_IDS_H_\n";
+  return file ? 0 : -1;
+}
@@ -0,0 +1,71 @@
+#ifndef FACE_MODEL_FILE_H_
+#define FACE_MODEL_FILE_H_
+
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace face
+{
+// Layers of an ncnn .param with their weights read from a float .bin, for
+// tools writing converted copies of the MTCNN models. Layers with weights
+// may be Convolution, InnerProduct and PReLU, as in det1-det4.
+class ModelFile
+{
+public:
+  struct Layer {
+    std::string type;
+    std::string name;
+    std::vector<std::string> bottoms, tops;
+    std::map<int, int> params;   // key=value, arrays left out
+    int num_output = 0;
+    bool bias = false;
+    std::vector<float> weights;  // Convolution, InnerProduct
+    std::vector<float> bias_data;
+    std::vector<float> slopes;   // PReLU
+  };
+
+  /// @brief Read model_dir/name.param and name.bin.
+  /// @return 0 on success, -1 if files are missing or hold other layers
+  /// with weights, or weights not stored as float32.
+  int Load(const std::string & model_dir, const std::string & name);
+  /// @brief Layer whose output goes into PReLU, maybe through Dropout.
+  bool Hidden(const Layer & layer) const;
+
+  /// @brief Lines of a .param, ending blanks removed.
+  static bool ReadParam(const std::string & path, std::vector<std::string> & lines);
+  /// @brief Layer of a .param line, without weights.
+  static bool ParseLine(const std::string & line, Layer & layer);
+  /// @brief Copy params of model_dir into out_dir, each layer line passed
+  /// to edit with its layer, which may change it. The binary param of each
+  /// is written along, see SaveParamBin.
+  /// @return 0 on success, -1 if a file can't be read or written.
+  static int CopyParams(const std::string & model_dir, const std::string & out_dir,
+    const std::vector<std::string> & params,
+    const std::function<void(const Layer & layer, std::string & line)> & edit);
+  /// @brief Write a text .param as the binary param ncnn load_param_bin
+  /// and load_param(const unsigned char*) read. Blobs are numbered as ncnn
+  /// numbers them loading the text one, custom layers by CustomLayerIndex.
+  /// @param blobs: if given, names of the blobs by index.
+  /// @return 0 on success, -1 if a file can't be read or written, or a
+  /// layer type is unknown.
+  static int SaveParamBin(const std::string & param_path, const std::string & out_path,
+    std::vector<std::string>* blobs = nullptr);
+  /// @brief Write a header of blob indices, for each param and its blob
+  /// names a namespace <param>_param_id of const int BLOB_<name>, as ncnn2mem
+  /// writes them, characters not allowed in names as '_'.
+  /// @return 0 on success, -1 if header can't be written.
+  static int SaveBlobIds(const std::string & header_path,
+    const std::vector<std::pair<std::string, std::vector<std::string>>> & params);
+  /// @brief Write raw float32 data, as bias and PReLU slopes are stored.
+  static void WriteFloats(FILE* fp, const std::vector<float> & data);
+
+  std::string model_dir, name;
+  std::vector<Layer> layers;
+};
+
+} // namespace face
+
+#endif // FACE_MODEL_FILE_H_
@@ -0,0 +1,191 @@
+// generated from models by ModelFile::SaveBlobIds, do not edit
+#ifndef FACE_MODEL_IDS_H_
+#define FACE_MODEL_IDS_H_
+
+namespace face
+{
+namespace det1_head_param_id {
+const int BLOB_data = 0;
+const int BLOB_threshold = 1;
+const int BLOB_pool1 = 2;
+const int BLOB_conv2_prelu2 = 3;
+const int BLOB_conv3_prelu3 = 4;
+const int BLOB_candidates = 5;
+} // namespace det1_head_param_id
+
+namespace det1_mosaic_param_id {
+const int BLOB_data = 0;
+const int BLOB_mask = 1;
+const int BLOB_threshold = 2;
+const int BLOB_conv1_prelu1 = 3;
+const int BLOB_pool1 = 4;
+const int BLOB_conv2_prelu2 = 5;
+const int BLOB_conv3_prelu3 = 6;
+const int BLOB_candidates = 7;
+} // namespace det1_mosaic_param_id
+
+namespace det2_param_id {
+const int BLOB_data = 0;
+const int BLOB_conv1 = 1;
+const int BLOB_conv1_prelu1 = 2;
+const int BLOB_pool1 = 3;
+const int BLOB_conv2 = 4;
+const int BLOB_conv2_prelu2 = 5;
+const int BLOB_pool2 = 6;
+const int BLOB_conv3 = 7;
+const int BLOB_conv3_prelu3 = 8;
+const int BLOB_fc4 = 9;
+const int BLOB_fc4_prelu4 = 10;
+const int BLOB_fc4_prelu4_splitncnn_0 = 11;
+const int BLOB_fc4_prelu4_splitncnn_1 = 12;
+const int BLOB_fc5_1 = 13;
+const int BLOB_fc5_2 = 14;
+const int BLOB_prob1 = 15;
+} // namespace det2_param_id
+
+namespace det2_batch_param_id {
+const int BLOB_data = 0;
+const int BLOB_conv1 = 1;
+const int BLOB_conv1_prelu1 = 2;
+const int BLOB_pool1 = 3;
+const int BLOB_conv2 = 4;
+const int BLOB_conv2_prelu2 = 5;
+const int BLOB_pool2 = 6;
+const int BLOB_conv3 = 7;
+const int BLOB_conv3_prelu3 = 8;
+const int BLOB_flatten = 9;
+const int BLOB_fc4 = 10;
+const int BLOB_fc4_prelu4 = 11;
+const int BLOB_fc4_prelu4_splitncnn_0 = 12;
+const int BLOB_fc4_prelu4_splitncnn_1 = 13;
+const int BLOB_fc5_1 = 14;
+const int BLOB_fc5_2 = 15;
+const int BLOB_prob1 = 16;
+} // namespace det2_batch_param_id
+
+namespace det3_param_id {
+const int BLOB_data = 0;
+const int BLOB_conv1 = 1;
+const int BLOB_conv1_prelu1 = 2;
+const int BLOB_pool1 = 3;
+const int BLOB_conv2 = 4;
+const int BLOB_conv2_prelu2 = 5;
+const int BLOB_pool2 = 6;
+const int BLOB_conv3 = 7;
+const int BLOB_conv3_prelu3 = 8;
+const int BLOB_pool3 = 9;
+const int BLOB_conv4 = 10;
+const int BLOB_conv4_prelu4 = 11;
+const int BLOB_fc5 = 12;
+const int BLOB_fc5_drop5 = 13;
+const int BLOB_fc5_prelu5 = 14;
+const int BLOB_fc5_prelu5_splitncnn_0 = 15;
+const int BLOB_fc5_prelu5_splitncnn_1 = 16;
+const int BLOB_fc5_prelu5_splitncnn_2 = 17;
+const int BLOB_fc6_1 = 18;
+const int BLOB_fc6_2 = 19;
+const int BLOB_fc6_3 = 20;
+const int BLOB_prob1 = 21;
+} // namespace det3_param_id
+
+namespace det3_batch_param_id {
+const int BLOB_data = 0;
+const int BLOB_conv1 = 1;
+const int BLOB_conv1_prelu1 = 2;
+const int BLOB_pool1 = 3;
+const int BLOB_conv2 = 4;
+const int BLOB_conv2_prelu2 = 5;
+const int BLOB_pool2 = 6;
+const int BLOB_conv3 = 7;
+const int BLOB_conv3_prelu3 = 8;
+const int BLOB_pool3 = 9;
+const int BLOB_conv4 = 10;
+const int BLOB_conv4_prelu4 = 11;
+const int BLOB_flatten = 12;
+const int BLOB_fc5 = 13;
+const int BLOB_fc5_drop5 = 14;
+const int BLOB_fc5_prelu5 = 15;
+const int BLOB_fc5_prelu5_splitncnn_0 = 16;
+const int BLOB_fc5_prelu5_splitncnn_1 = 17;
+const int BLOB_fc5_prelu5_splitncnn_2 = 18;
+const int BLOB_fc6_1 = 19;
+const int BLOB_fc6_2 = 20;
+const int BLOB_fc6_3 = 21;
+const int BLOB_prob1 = 22;
+} // namespace det3_batch_param_id
+
+namespace det4_param_id {
+const int BLOB_data = 0;
+const int BLOB_data241 = 1;
+const int BLOB_data242 = 2;
+const int BLOB_data243 = 3;
+const int BLOB_data244 = 4;
+const int BLOB_data245 = 5;
+const int BLOB_conv1_1 = 6;
+const int BLOB_conv1_1_prelu1_1 = 7;
+const int BLOB_pool1_1 = 8;
+const int BLOB_conv2_1 = 9;
+const int BLOB_conv2_1_prelu2_1 = 10;
+const int BLOB_pool2_1 = 11;
+const int BLOB_conv3_1 = 12;
+const int BLOB_conv3_1_prelu3_1 = 13;
+const int BLOB_conv1_2 = 14;
+const int BLOB_conv1_2_prelu1_2 = 15;
+const int BLOB_pool1_2 = 16;
+const int BLOB_conv2_2 = 17;
+const int BLOB_conv2_2_prelu2_2 = 18;
+const int BLOB_pool2_2 = 19;
+const int BLOB_conv3_2 = 20;
+const int BLOB_conv3_2_prelu3_2 = 21;
+const int BLOB_conv1_3 = 22;
+const int BLOB_conv1_3_prelu1_3 = 23;
+const int BLOB_pool1_3 = 24;
+const int BLOB_conv2_3 = 25;
+const int BLOB_conv2_3_prelu2_3 = 26;
+const int BLOB_pool2_3 = 27;
+const int BLOB_conv3_3 = 28;
+const int BLOB_conv3_3_prelu3_3 = 29;
+const int BLOB_conv1_4 = 30;
+const int BLOB_conv1_4_prelu1_4 = 31;
+const int BLOB_pool1_4 = 32;
+const int BLOB_conv2_4 = 33;
+const int BLOB_conv2_4_prelu2_4 = 34;
+const int BLOB_pool2_4 = 35;
+const int BLOB_conv3_4 = 36;
+const int BLOB_conv3_4_prelu3_4 = 37;
+const int BLOB_conv1_5 = 38;
+const int BLOB_conv1_5_prelu1_5 = 39;
+const int BLOB_pool1_5 = 40;
+const int BLOB_conv2_5 = 41;
+const int BLOB_conv2_5_prelu2_5 = 42;
+const int BLOB_pool2_5 = 43;
+const int BLOB_conv3_5 = 44;
+const int BLOB_conv3_5_prelu3_5 = 45;
+const int BLOB_conv3 = 46;
+const int BLOB_fc4 = 47;
+const int BLOB_fc4_prelu4 = 48;
+const int BLOB_fc4_prelu4_splitncnn_0 = 49;
+const int BLOB_fc4_prelu4_splitncnn_1 = 50;
+const int BLOB_fc4_prelu4_splitncnn_2 = 51;
+const int BLOB_fc4_prelu4_splitncnn_3 = 52;
+const int BLOB_fc4_prelu4_splitncnn_4 = 53;
+const int BLOB_fc4_1 = 54;
+const int BLOB_fc4_1_prelu4_1 = 55;
+const int BLOB_fc5_1 = 56;
+const int BLOB_fc4_2 = 57;
+const int BLOB_fc4_2_prelu4_2 = 58;
+const int BLOB_fc5_2 = 59;
+const int BLOB_fc4_3 = 60;
+const int BLOB_fc4_3_prelu4_3 = 61;
+const int BLOB_fc5_3 = 62;
+const int BLOB_fc4_4 = 63;
+const int BLOB_fc4_4_prelu4_4 = 64;
+const int BLOB_fc5_4 = 65;
+const int BLOB_fc4_5 = 66;
+const int BLOB_fc4_5_prelu4_5 = 67;
+const int BLOB_fc5_5 = 68;
+} // namespace det4_param_id
+
+} // namespace face
+
+#endif // FACE_MODEL_IDS_H_
@@ -1,10 +1,11 @@
-#include <algorithm>  // std::min, std::max, std::sort
-//#define USE_OPENMP
-#ifdef USE_OPENMP
-#include <omp.h>
-#endif
+#include <algorithm>  // std::min, std::max, std::sort, std::reverse
+#include <cstdio>
 
 #include "mtcnn.h"
+#include "layers.h"
+#include "model_ids.h"
+#include "thread_pool.h"
+#include "warp.h"
 using namespace std;
 using namespace face;
 
@@ -15,48 +16,285 @@ int fix(float f)
   return static_cast<int>(f);
 }
 
-Mtcnn::Mtcnn(const string & model_dir, bool Lnet) :
-  lnet(Lnet)
+#ifdef MTCNN_EMBED_MODELS
+// params and weights as arrays, written by cmake/embed_models.cmake
+#include "mtcnn_models.mem.h"
+
+static const struct {
+  const char* name;
+  const unsigned char* data;
+} embedded_models[] = {
+  {"det1_head.param.bin", det1_head_param_bin},
+  {"det1_mosaic.param.bin", det1_mosaic_param_bin},
+  {"det2.param.bin", det2_param_bin},
+  {"det2_batch.param.bin", det2_batch_param_bin},
+  {"det3.param.bin", det3_param_bin},
+  {"det3_batch.param.bin", det3_batch_param_bin},
+  {"det4.param.bin", det4_param_bin},
+  {"det1.bin", det1_bin},
+  {"det2.bin", det2_bin},
+  {"det3.bin", det3_bin},
+  {"det4.bin", det4_bin}
+};
+
+static const unsigned char* EmbeddedModel(const string & name)
 {
-  // load models
-  Pnet.load_param((model_dir + "/det1.param").data());
-  Pnet.load_model((model_dir + "/det1.bin").data());
-  Rnet.load_param((model_dir + "/det2.param").data());
-  Rnet.load_model((model_dir + "/det2.bin").data());
-  Onet.load_param((model_dir + "/det3.param").data());
-  Onet.load_model((model_dir + "/det3.bin").data());
-  if (lnet) {
-    this->Lnet.load_param((model_dir + "/det4.param").data());
-    this->Lnet.load_model((model_dir + "/det4.bin").data());
+  for (const auto & model : embedded_models) {
+    if (name == model.name)
+      return model.data;
   }
+  return 0;
+}
+#endif
+
+// Load param and bin of model_dir into net, or with an empty model_dir the
+// ones compiled in, used in place without file reads or copies. The binary
+// param, param.bin, is loaded if model_dir has it, else the text one: both
+// number blobs as model_ids.h does. With mapped_bins, bin is mapped once
+// into it and its weights used in place as well.
+static void LoadNet(ncnn::Net & net, const string & model_dir,
+  const string & param, const string & bin, map<string, MappedFile>* mapped_bins)
+{
+  RegisterCustomLayers(net);
+#ifdef MTCNN_EMBED_MODELS
+  if (model_dir.empty()) {
+    net.load_param(EmbeddedModel(param + ".bin"));
+    net.load_model(EmbeddedModel(bin));
+    return;
+  }
+#endif
+  string param_path = model_dir + "/" + param;
+  FILE* fp = fopen((param_path + ".bin").c_str(), "rb");
+  if (fp) {
+    net.load_param_bin(fp);
+    fclose(fp);
+  } else {
+    net.load_param(param_path.data());
+  }
+  if (mapped_bins) {
+    MappedFile & file = (*mapped_bins)[bin];
+    if (file.data() || file.Open(model_dir + "/" + bin) == 0) {
+      net.load_model(file.data());
+      return;
+    }
+  }
+  net.load_model((model_dir + "/" + bin).data());
+}
+
+Mtcnn::Mtcnn(const string & model_dir, bool Lnet, bool map_models) :
+  lnet(Lnet)
+{
+  // load models, the head, mosaic and batch params share weights
+  map<string, MappedFile>* bins = map_models ? &mapped_bins : nullptr;
+  LoadNet(Pnet, model_dir, "det1_head.param", "det1.bin", bins);
+  LoadNet(Rnet, model_dir, "det2.param", "det2.bin", bins);
+  LoadNet(Onet, model_dir, "det3.param", "det3.bin", bins);
+  LoadNet(PnetMosaic, model_dir, "det1_mosaic.param", "det1.bin", bins);
+  LoadNet(RnetBatch, model_dir, "det2_batch.param", "det2.bin", bins);
+  LoadNet(OnetBatch, model_dir, "det3_batch.param", "det3.bin", bins);
+  if (lnet)
+    LoadNet(this->Lnet, model_dir, "det4.param", "det4.bin", bins);
 }
 
 Mtcnn::~Mtcnn() {
+  pool.clear();
+  workers.reset();
   Pnet.clear();
   Rnet.clear();
   Onet.clear();
+  PnetMosaic.clear();
+  RnetBatch.clear();
+  OnetBatch.clear();
   if (lnet)
     Lnet.clear();
 }
 
 vector<BBox> Mtcnn::Detect(const ncnn::Mat & image)
 {
-  vector<_BBox> _bboxes = ProposalNetwork(image);
-  RefineNetwork(image, _bboxes);
-  OutputNetwork(image, _bboxes);
+  return Detect(_Image(image));
+}
+
+vector<BBox> Mtcnn::Detect(const ImageView & image)
+{
+  return Detect(_Image(image));
+}
+
+vector<BBox> Mtcnn::Detect(const unsigned char* pixels, int width, int height,
+  int stride, PixelFormat format)
+{
+  return Detect(ImageView(pixels, width, height, stride, format));
+}
+
+// Rois clipped to width x height, empty ones dropped.
+static vector<Roi> ClipRois(const vector<Roi> & rois, int width, int height)
+{
+  vector<Roi> clipped;
+  for (const Roi & roi : rois) {
+    Roi clip(std::max<int>(roi.x1, 0), std::max<int>(roi.y1, 0),
+      std::min<int>(roi.x2, width), std::min<int>(roi.y2, height));
+    if (clip.x1 < clip.x2 && clip.y1 < clip.y2)
+      clipped.push_back(clip);
+  }
+  return clipped;
+}
+
+// Runs of mask tiles not all 0 along every row of tiles.
+static vector<Roi> MaskTiles(const ImageView & mask)
+{
+  const int tile = 32;
+  vector<Roi> rois;
+  for (int y1 = 0; y1 < mask.height; y1 += tile) {
+    int y2 = std::min<int>(y1 + tile, mask.height);
+    int run = -1;  // first x of current run
+    for (int x1 = 0; x1 < mask.width; x1 += tile) {
+      int x2 = std::min<int>(x1 + tile, mask.width);
+      bool set = false;
+      for (int y = y1; y < y2 && !set; y++) {
+        const unsigned char* row = mask.data + mask.stride * y;
+        set = find_if(row + x1, row + x2, [](unsigned char m) { return m != 0; }) != row + x2;
+      }
+      if (set && run < 0)
+        run = x1;
+      if (!set && run >= 0) {
+        rois.push_back(Roi(run, y1, x1, y2));
+        run = -1;
+      }
+    }
+    if (run >= 0)
+      rois.push_back(Roi(run, y1, mask.width, y2));
+  }
+  return rois;
+}
+
+vector<BBox> Mtcnn::Detect(const ncnn::Mat & image, const vector<Roi> & rois)
+{
+  _Region region = { ClipRois(rois, image.w, image.h), 0 };
+  return Detect(_Image(image), &region);
+}
+
+vector<BBox> Mtcnn::Detect(const ImageView & image, const vector<Roi> & rois)
+{
+  _Region region = { ClipRois(rois, image.width, image.height), 0 };
+  return Detect(_Image(image), &region);
+}
+
+vector<BBox> Mtcnn::Detect(const ncnn::Mat & image, const ImageView & mask)
+{
+  _Region region = { MaskTiles(mask), &mask };
+  return Detect(_Image(image), &region);
+}
+
+vector<BBox> Mtcnn::Detect(const ImageView & image, const ImageView & mask)
+{
+  _Region region = { MaskTiles(mask), &mask };
+  return Detect(_Image(image), &region);
+}
+
+vector<BBox> Mtcnn::Detect(const Mtcnn::_Image & image, const Mtcnn::_Region * region)
+{
+  unique_ptr<Context> ctx = AcquireContext();
+  vector<_BBox> _bboxes = ProposalNetwork(*ctx, image, region);
+  vector<BBox> bboxes = Cascade(*ctx, image, _bboxes);
+  ReleaseContext(std::move(ctx));
+  return bboxes;
+}
+
+vector<vector<BBox>> Mtcnn::DetectBatch(const vector<ImageView> & images)
+{
+  vector<_Image> _images;
+  for (const ImageView & image : images)
+    _images.emplace_back(image);
+  unique_ptr<Context> ctx = AcquireContext();
+  vector<vector<_BBox>> proposals;
+  ProposalNetwork(*ctx, _images, proposals);
+  vector<vector<BBox>> bboxes = Cascade(*ctx, _images, proposals);
+  ReleaseContext(std::move(ctx));
+  return bboxes;
+}
+
+vector<BBox> Mtcnn::DetectLargest(const ncnn::Mat & image, int k)
+{
+  return DetectLargest(_Image(image), k);
+}
+
+vector<BBox> Mtcnn::DetectLargest(const ImageView & image, int k)
+{
+  return DetectLargest(_Image(image), k);
+}
+
+// Intersection over union of two boxes.
+static float IntersectionOverUnion(const BBox & a, const BBox & b)
+{
+  int x1 = std::max<int>(a.x1, b.x1);
+  int y1 = std::max<int>(a.y1, b.y1);
+  int x2 = std::min<int>(a.x2, b.x2);
+  int y2 = std::min<int>(a.y2, b.y2);
+  if (x1 >= x2 || y1 >= y2)
+    return 0.f;
+  int inter = (x2 - x1) * (y2 - y1);
+  return static_cast<float>(inter) / (a.area() + b.area() - inter);
+}
+
+vector<BBox> Mtcnn::DetectLargest(const Mtcnn::_Image & image, int k)
+{
+  if (k <= 0)
+    return vector<BBox>();
+  unique_ptr<Context> ctx = AcquireContext();
+  if (ctx->levels.empty())
+    ctx->levels.resize(1);
+  vector<float> scales = ScalePyramid(std::min<int>(image.w, image.h));
+  // largest faces first
+  std::reverse(scales.begin(), scales.end());
+  vector<_BBox> proposed, faces;
+  auto larger = [](const _BBox & a, const _BBox & b) {
+    return std::max<int>(a.x2 - a.x1, a.y2 - a.y1) > std::max<int>(b.x2 - b.x1, b.y2 - b.y1);
+  };
+  for (size_t l = 0; l < scales.size(); l++) {
+    vector<_BBox> _bboxes = ScaleNetwork(*ctx, image, scales[l], ctx->levels[0]);
+    BoxRegression(_bboxes, true);
+    // regions a larger scale has already proposed are done
+    vector<char> flags(_bboxes.size(), 1);
+    for (size_t i = 0; i < _bboxes.size(); i++)
+      for (const _BBox & _bbox : proposed)
+        if (IntersectionOverUnion(_bboxes[i], _bbox) > 0.7f) {
+          flags[i] = 0;
+          break;
+        }
+    KeepFlagged(_bboxes, flags);
+    proposed.insert(proposed.end(), _bboxes.begin(), _bboxes.end());
+    RefineNetwork(*ctx, image, _bboxes);
+    OutputNetwork(*ctx, image, _bboxes);
+    if (!_bboxes.empty()) {
+      faces.insert(faces.end(), _bboxes.begin(), _bboxes.end());
+      NonMaximumSuppression(faces, 0.7f, IoM, nms_methods[2]);
+    }
+    // a later scale finds faces about as large as its Pnet window
+    if (static_cast<int>(faces.size()) >= k && l + 1 < scales.size()) {
+      std::nth_element(faces.begin(), faces.begin() + (k - 1), faces.end(), larger);
+      const _BBox & kth = faces[k - 1];
+      if (std::max<int>(kth.x2 - kth.x1, kth.y2 - kth.y1) >= 12.0f / scales[l + 1])
+        break;
+    }
+  }
+  std::sort(faces.begin(), faces.end(), larger);
+  if (static_cast<int>(faces.size()) > k)
+    faces.erase(faces.begin() + k, faces.end());
   if (precise_landmark && lnet)
-    LandmarkNetwork(image, _bboxes);
+    LandmarkNetwork(*ctx, image, faces);
+  ReleaseContext(std::move(ctx));
   vector<BBox> bboxes;
-  for (const _BBox & _bbox : _bboxes)
+  for (const _BBox & _bbox : faces)
     bboxes.emplace_back(_bbox.base());
   return bboxes;
 }
 
 BBox Mtcnn::Landmark(const ncnn::Mat & image, BBox bbox) {
+  unique_ptr<Context> ctx = AcquireContext();
   vector<_BBox> _bboxes = { _BBox(bbox) };
-  OutputNetwork(image, _bboxes);
+  OutputNetwork(*ctx, _Image(image), _bboxes);
   if (precise_landmark && lnet)
-    LandmarkNetwork(image, _bboxes);
+    LandmarkNetwork(*ctx, _Image(image), _bboxes);
+  ReleaseContext(std::move(ctx));
   if (!_bboxes.empty()) {
     return _bboxes[0].base();
   }
@@ -65,6 +303,237 @@ BBox Mtcnn::Landmark(const ncnn::Mat & image, BBox bbox) {
   }
 }
 
+vector<BBox> Mtcnn::Refine(const ncnn::Mat & image, const vector<BBox> & proposals)
+{
+  return Refine(_Image(image), proposals);
+}
+
+vector<BBox> Mtcnn::Refine(const ImageView & image, const vector<BBox> & proposals)
+{
+  return Refine(_Image(image), proposals);
+}
+
+vector<BBox> Mtcnn::Refine(const Mtcnn::_Image & image, const vector<BBox> & proposals)
+{
+  unique_ptr<Context> ctx = AcquireContext();
+  vector<_BBox> _bboxes;
+  for (const BBox & bbox : proposals)
+    _bboxes.emplace_back(bbox);
+  vector<BBox> bboxes = Cascade(*ctx, image, _bboxes);
+  ReleaseContext(std::move(ctx));
+  return bboxes;
+}
+
+ImageView::ImageView(const unsigned char* data, int width, int height, int stride,
+  PixelFormat format) :
+  data(data), u(0), v(0), width(width), height(height),
+  stride(stride), uv_stride(0), format(format)
+{
+  const unsigned char* chroma = data + (size_t)stride * height;
+  switch (format) {
+  case PIXEL_NV21:
+    v = chroma;
+    u = chroma + 1;
+    uv_stride = stride;
+    break;
+  case PIXEL_NV12:
+    u = chroma;
+    v = chroma + 1;
+    uv_stride = stride;
+    break;
+  case PIXEL_I420:
+    uv_stride = stride / 2;
+    u = chroma;
+    v = chroma + (size_t)uv_stride * ((height + 1) / 2);
+    break;
+  default:
+    break;
+  }
+}
+
+ImageView::ImageView(const unsigned char* y, const unsigned char* u, const unsigned char* v,
+  int width, int height, int stride, int uv_stride, PixelFormat format) :
+  data(y), u(u), v(v), width(width), height(height),
+  stride(stride), uv_stride(uv_stride), format(format)
+{
+}
+
+Mtcnn::_Image::_Image(const ncnn::Mat & mat) :
+  w(mat.w), h(mat.h), c(mat.c), mat(&mat), view(0, 0, 0, 0), yuv(false), step(0)
+{
+}
+
+Mtcnn::_Image::_Image(const ImageView & view) :
+  w(view.width), h(view.height), c(3), mat(0), view(view),
+  yuv(view.format == PIXEL_NV21 || view.format == PIXEL_NV12 || view.format == PIXEL_I420)
+{
+  // planar BGR of model input
+  if (view.format == PIXEL_GRAY) {
+    step = 1;
+    offsets[0] = offsets[1] = offsets[2] = 0;
+    return;
+  }
+  if (yuv) {
+    step = view.format == PIXEL_I420 ? 1 : 2;
+    return;
+  }
+  bool bgr = view.format == PIXEL_BGR || view.format == PIXEL_BGRA;
+  step = view.format == PIXEL_BGR || view.format == PIXEL_RGB ? 3 : 4;
+  offsets[0] = bgr ? 0 : 2;
+  offsets[1] = 1;
+  offsets[2] = bgr ? 2 : 0;
+}
+
+void Mtcnn::_Image::Warp(int x1, int y1, int x2, int y2, int w, int h,
+  float* dst, size_t cstep, ncnn::Allocator * allocator) const
+{
+  if (mat)
+    WarpRoi(*mat, x1, y1, x2, y2, w, h, dst, cstep, allocator);
+  else if (yuv)
+    WarpRoiYUV420(view.data, view.u, view.v, this->w, this->h, view.stride, view.uv_stride,
+      step, x1, y1, x2, y2, w, h, dst, cstep, allocator);
+  else
+    WarpRoi(view.data, this->w, this->h, view.stride, step, offsets, c,
+      x1, y1, x2, y2, w, h, dst, cstep, allocator);
+}
+
+void Mtcnn::_Image::Warp(int x1, int y1, int x2, int y2, ncnn::Mat & dst, int w, int h,
+  ncnn::Allocator * allocator) const
+{
+  dst.create(w, h, c, 4u, allocator);
+  if (dst.empty())
+    return;
+  Warp(x1, y1, x2, y2, w, h, (float*)dst.data, dst.cstep, allocator);
+}
+
+void Mtcnn::_Image::Warp(int x1, int y1, int x2, int y2, int w, int h, const Roi & window,
+  ncnn::Mat & dst, ncnn::Allocator * allocator) const
+{
+  WarpWindow part = { window.x1, window.y1, window.x2 - window.x1, window.y2 - window.y1 };
+  dst.create(part.w, part.h, c, 4u, allocator);
+  if (dst.empty())
+    return;
+  float* data = (float*)dst.data;
+  if (mat)
+    WarpRoi(*mat, x1, y1, x2, y2, w, h, part, data, dst.cstep, allocator);
+  else if (yuv)
+    WarpRoiYUV420(view.data, view.u, view.v, this->w, this->h, view.stride, view.uv_stride,
+      step, x1, y1, x2, y2, w, h, part, data, dst.cstep, allocator);
+  else
+    WarpRoi(view.data, this->w, this->h, view.stride, step, offsets, c,
+      x1, y1, x2, y2, w, h, part, data, dst.cstep, allocator);
+}
+
+bool Mtcnn::_Region::Contains(int x, int y) const
+{
+  if (mask)
+    return x >= 0 && x < mask->width && y >= 0 && y < mask->height
+      && mask->data[mask->stride * y + x] != 0;
+  for (const Roi & roi : rois) {
+    if (x >= roi.x1 && x < roi.x2 && y >= roi.y1 && y < roi.y2)
+      return true;
+  }
+  return false;
+}
+
+static int Area(const Roi & roi)
+{
+  return (roi.x2 - roi.x1) * (roi.y2 - roi.y1);
+}
+
+vector<Roi> Mtcnn::_Region::LevelCrops(float scale, int w, int h) const
+{
+  // Pnet cell (j, i) sees level pixels [2j, 2j + 12) x [2i, 2i + 12),
+  // crops hold every cell seeing a roi. They start even and, unless they
+  // end at the level border, are even sized, so pool1 windows and cells
+  // fall as in the whole level.
+  const int field = 12;
+  vector<Roi> crops;
+  for (const Roi & roi : rois) {
+    int x1 = std::max<int>(static_cast<int>(floor(roi.x1 * scale)) - field, 0) & ~1;
+    int y1 = std::max<int>(static_cast<int>(floor(roi.y1 * scale)) - field, 0) & ~1;
+    int x2 = static_cast<int>(ceil(roi.x2 * scale)) + field;
+    int y2 = static_cast<int>(ceil(roi.y2 * scale)) + field;
+    x2 = x2 >= w ? w : std::min<int>(x1 + ((x2 - x1 + 1) & ~1), w);
+    y2 = y2 >= h ? h : std::min<int>(y1 + ((y2 - y1 + 1) & ~1), h);
+    if (x2 - x1 >= field && y2 - y1 >= field)
+      crops.push_back(Roi(x1, y1, x2, y2));
+  }
+  // merge two crops while their bounds cost no more than both,
+  // bounds of aligned crops are aligned as well.
+  for (bool merged = true; merged;) {
+    merged = false;
+    for (size_t i = 0; i < crops.size() && !merged; i++) {
+      for (size_t j = i + 1; j < crops.size(); j++) {
+        Roi bounds(std::min<int>(crops[i].x1, crops[j].x1), std::min<int>(crops[i].y1, crops[j].y1),
+          std::max<int>(crops[i].x2, crops[j].x2), std::max<int>(crops[i].y2, crops[j].y2));
+        if (Area(bounds) <= Area(crops[i]) + Area(crops[j])) {
+          crops[i] = bounds;
+          crops.erase(crops.begin() + j);
+          merged = true;
+          break;
+        }
+      }
+    }
+  }
+  return crops;
+}
+
+FrameAllocator::Stats Mtcnn::MemoryStats()
+{
+  lock_guard<mutex> lock(pool_mutex);
+  return last_stats;
+}
+
+unique_ptr<Mtcnn::Context> Mtcnn::AcquireContext()
+{
+  unique_ptr<Context> ctx;
+  {
+    lock_guard<mutex> lock(pool_mutex);
+    if (!pool.empty()) {
+      ctx = std::move(pool.back());
+      pool.pop_back();
+    }
+  }
+  if (!ctx)
+    ctx.reset(new Context());
+  ctx->allocator.ResetStats();
+  return ctx;
+}
+
+void Mtcnn::ReleaseContext(unique_ptr<Mtcnn::Context> ctx)
+{
+  FrameAllocator::Stats stats = ctx->allocator.stats();
+  lock_guard<mutex> lock(pool_mutex);
+  last_stats = stats;
+  pool.push_back(std::move(ctx));
+}
+
+ncnn::Extractor Mtcnn::CreateExtractor(Mtcnn::Context & ctx, const ncnn::Net & net)
+{
+  ncnn::Extractor ex = net.create_extractor();
+  ex.set_blob_allocator(&ctx.allocator);
+  ex.set_workspace_allocator(&ctx.allocator);
+  return ex;
+}
+
+void Mtcnn::ParallelFor(int n, const function<void(int)> & func)
+{
+  if (num_threads <= 1 || n <= 1) {
+    for (int i = 0; i < n; i++)
+      func(i);
+    return;
+  }
+  shared_ptr<ThreadPool> thread_pool;
+  {
+    lock_guard<mutex> lock(pool_mutex);
+    if (!workers || workers->size() != num_threads)
+      workers = make_shared<ThreadPool>(num_threads);
+    thread_pool = workers;
+  }
+  thread_pool->ParallelFor(n, func);
+}
+
 vector<float> Mtcnn::ScalePyramid(const int min_len)
 {
   vector<float> scales;
@@ -75,73 +544,48 @@ vector<float> Mtcnn::ScalePyramid(const int min_len)
   return scales;
 }
 
-vector<Mtcnn::_BBox> Mtcnn::GetCandidates(const float scale, 
-  const ncnn::Mat & conf_blob, const ncnn::Mat & loc_blob)
+vector<Mtcnn::_BBox> Mtcnn::GetCandidates(const float scale,
+  const ncnn::Mat & candidates, int x0, int y0, int w, int h)
 {
   int stride = 2;
   int cell_size = 12;
   float inv_scale = 1.0f / scale;
   vector<_BBox> condidates;
 
-  int id = 0;
-  for (int i = 0; i < conf_blob.h; ++i)
-    for (int j = 0; j < conf_blob.w; ++j) {
-      float score = conf_blob.channel(1)[id];
-      if (score >= thresholds[0]) {
-        condidates.emplace_back();
-        _BBox & _bbox = *condidates.rbegin();
-        _bbox.score = score;
-        _bbox.x1 = round((j * stride + 1) * inv_scale) - 1;
-        _bbox.y1 = round((i * stride + 1) * inv_scale) - 1;
-        _bbox.x2 = round((j * stride + cell_size) * inv_scale);
-        _bbox.y2 = round((i * stride + cell_size) * inv_scale);
-        for (int i = 0; i < 4; i++)
-          _bbox.regs[i] = loc_blob.channel(i)[id];
-      }
-      id++;
-    }
+  // rows of (x, y, score, 4 regressions), already above threshold
+  for (int k = 0; k < candidates.h; ++k) {
+    const float* row = candidates.row(k);
+    int j = static_cast<int>(row[0]) - x0;
+    int i = static_cast<int>(row[1]) - y0;
+    if (w >= 0 && (j < 0 || j >= w || i < 0 || i >= h))
+      continue;
+    condidates.emplace_back();
+    _BBox & _bbox = *condidates.rbegin();
+    _bbox.score = row[2];
+    _bbox.x1 = round((j * stride + 1) * inv_scale) - 1;
+    _bbox.y1 = round((i * stride + 1) * inv_scale) - 1;
+    _bbox.x2 = round((j * stride + cell_size) * inv_scale);
+    _bbox.y2 = round((i * stride + cell_size) * inv_scale);
+    for (int i = 0; i < 4; i++)
+      _bbox.regs[i] = row[3 + i];
+  }
   return condidates;
 }
 
 void Mtcnn::NonMaximumSuppression(std::vector<Mtcnn::_BBox> & _bboxes,
-  const float threshold, const NMS_TYPE type) {
+  const float threshold, const NMS_TYPE type, NmsMethod method) {
   if (_bboxes.size() <= 1)
     return;
 
-  sort(_bboxes.begin(), _bboxes.end(),
-    // Lambda function: descending order by score.
-    [](const _BBox & x, const _BBox & y) -> bool { return x.score > y.score; });
-
-  int keep = 0;  // index of candidates to be keeped
-  while (keep < _bboxes.size()) {
-    // pass maximun candidates.
-    const _BBox & _max = _bboxes[keep++];
-    int max_area = _max.area();
-    // filter out overlapped candidates in the rest.
-    for (int i = keep; i < _bboxes.size(); ) {
-      // computer intersection.
-      const _BBox & _bbox = _bboxes[i];
-      int x1 = std::max<int>(_max.x1, _bbox.x1);
-      int y1 = std::max<int>(_max.y1, _bbox.y1);
-      int x2 = std::min<int>(_max.x2, _bbox.x2);
-      int y2 = std::min<int>(_max.y2, _bbox.y2);
-      float overlap = 0.f;
-      if (x1 < x2 && y1 < y2) {
-        int inter = (x2 - x1) * (y2 - y1);
-        int outer;
-        if (type == IoM)  // Intersection over Minimum
-          outer = std::min<int>(max_area, _bbox.area());
-        else  // Intersection over Union
-          outer = max_area + _bbox.area() - inter;
-        overlap = static_cast<float>(inter) / outer;
-      }
-      if (overlap > threshold)
-        // erase overlapped candidate.
-        _bboxes.erase(_bboxes.begin() + i);
-      else
-        i++;  // check next candidate.
-    }
-  }
+  NmsBoxes boxes;
+  for (const _BBox & _bbox : _bboxes)
+    boxes.push_back(_bbox.x1, _bbox.y1, _bbox.x2, _bbox.y2, _bbox.score);
+  vector<int> keep = boxes.Suppress(threshold, type == IoM, method);
+  // kept candidates, descending order by score.
+  vector<_BBox> kept(keep.size());
+  for (size_t i = 0; i < keep.size(); i++)
+    kept[i] = _bboxes[keep[i]];
+  _bboxes.swap(kept);
 }
 
 void Mtcnn::BoxRegression(std::vector<Mtcnn::_BBox> & _bboxes, bool square)
@@ -173,167 +617,416 @@ void Mtcnn::BoxRegression(std::vector<Mtcnn::_BBox> & _bboxes, bool square)
   }
 }
 
-ncnn::Mat Mtcnn::PadCrop(const ncnn::Mat & image, int x1, int y1, int x2, int y2) 
+void Mtcnn::KeepFlagged(vector<Mtcnn::_BBox> & _bboxes, const vector<char> & flags)
 {
-  bool need_pad = x1 < 0 || y1 < 0 || x2 > image.w || y2 >= image.h;
-  ncnn::Mat crop, pad;
-  bool need_crop = true;
-  if (need_pad) {
-    // inside box
-    int _x1 = std::max<int>(x1, 0);
-    int _y1 = std::max<int>(y1, 0);
-    int _x2 = std::min<int>(x2, image.w);
-    int _y2 = std::min<int>(y2, image.h);
-    need_crop = _x1 < _x2 && _y1 < _y2;
-    if (need_crop) {
-      ncnn::copy_cut_border(image, crop, _y1, image.h-_y2, _x1, image.w-_x2);
-      ncnn::copy_make_border(crop, pad, _y1-y1, y2-_y2, _x1-x1, x2-_x2, 0, 0);
+  int keep = 0;
+  for (int i = 0; i < _bboxes.size(); i++) {
+    if (flags[i]) {
+      if (keep < i)
+        _bboxes[keep] = _bboxes[i];
+      keep++;
     }
   }
+  _bboxes.erase(_bboxes.begin() + keep, _bboxes.end());
+}
+
+void Mtcnn::Gather(vector<vector<Mtcnn::_BBox>> & _bboxes, vector<Mtcnn::_BBox> & all, vector<int> & owners)
+{
+  all.clear();
+  owners.clear();
+  if (_bboxes.size() == 1) {
+    all.swap(_bboxes[0]);
+    owners.assign(all.size(), 0);
+    return;
+  }
+  for (size_t i = 0; i < _bboxes.size(); i++) {
+    all.insert(all.end(), _bboxes[i].begin(), _bboxes[i].end());
+    owners.insert(owners.end(), _bboxes[i].size(), static_cast<int>(i));
+    _bboxes[i].clear();
+  }
+}
+
+void Mtcnn::Scatter(vector<Mtcnn::_BBox> & all, const vector<char> & flags, const vector<int> & owners,
+  vector<vector<Mtcnn::_BBox>> & _bboxes)
+{
+  if (_bboxes.size() == 1) {
+    KeepFlagged(all, flags);
+    _bboxes[0].swap(all);
+    return;
+  }
+  for (size_t k = 0; k < all.size(); k++) {
+    if (flags[k])
+      _bboxes[owners[k]].push_back(all[k]);
+  }
+}
+
+void Mtcnn::StackCrops(const vector<Mtcnn::_Image> & images, const vector<int> & owners,
+  const vector<Mtcnn::_BBox> & _bboxes, int begin, int count, int size, ncnn::Mat & stack,
+  ncnn::Allocator * allocator)
+{
+  stack.create(size, size * count, images[owners[begin]].c, 4u, allocator);
+  for (int k = 0; k < count; k++) {
+    const _BBox & _bbox = _bboxes[begin + k];
+    // tile k takes rows [k*size, (k+1)*size) of every channel
+    images[owners[begin + k]].Warp(_bbox.x1, _bbox.y1, _bbox.x2, _bbox.y2, size, size,
+      stack.row(k * size), stack.cstep, allocator);
+  }
+}
+
+vector<Mtcnn::_BBox> Mtcnn::ProposalNetwork(Mtcnn::Context & ctx, const Mtcnn::_Image & image,
+  const Mtcnn::_Region * region)
+{
+  vector<_Image> images(1, image);
+  vector<vector<_BBox>> proposals;
+  ProposalNetwork(ctx, images, proposals, region);
+  return proposals[0];
+}
+
+void Mtcnn::ProposalNetwork(Mtcnn::Context & ctx, const vector<Mtcnn::_Image> & images,
+  vector<vector<Mtcnn::_BBox>> & proposals, const Mtcnn::_Region * region)
+{
+  int n = static_cast<int>(images.size());
+  proposals.assign(n, vector<_BBox>());
+  // scales of every image, run as (image, scale) jobs
+  vector<vector<float>> scales(n);
+  vector<pair<int, int>> jobs;
+  for (int i = 0; i < n; i++) {
+    scales[i] = ScalePyramid(std::min<int>(images[i].w, images[i].h));
+    for (int l = 0; l < static_cast<int>(scales[i].size()); l++)
+      jobs.emplace_back(i, l);
+  }
+  if (pyramid_mosaic && !region) {
+    // canvas of context holds one mosaic at a time
+    for (int i = 0; i < n; i++)
+      proposals[i] = MosaicNetwork(ctx, images[i], scales[i]);
+  }
   else {
-    need_crop = x1 < x2 && y1 < y2;
-    if (need_crop)
-      ncnn::copy_cut_border(image, pad, y1, image.h-y2, x1, image.w-x2);
+    int count = static_cast<int>(jobs.size());
+    if (n == 1 && ctx.levels.size() < jobs.size())
+      ctx.levels.resize(jobs.size());
+    // candidates of every scale, merged in scale order afterwards
+    vector<vector<_BBox>> scale_bboxes(count);
+    ParallelFor(count, [&](int j) {
+      int i = jobs[j].first, l = jobs[j].second;
+      // levels of one image stay in context, those of a batch are freed
+      ncnn::Mat level;
+      ncnn::Mat & input = n == 1 ? ctx.levels[l] : level;
+      scale_bboxes[j] = ScaleNetwork(ctx, images[i], scales[i][l], input, region);
+    });
+    for (int j = 0; j < count; j++) {
+      vector<_BBox> & total_bboxes = proposals[jobs[j].first];
+      total_bboxes.insert(total_bboxes.end(), scale_bboxes[j].begin(), scale_bboxes[j].end());
+    }
   }
-  if (need_crop == false) {
-    pad.create(x2 - x1, y2 - y1, image.c, image.elemsize);
-    pad.fill(0.f);
+  for (vector<_BBox> & total_bboxes : proposals) {
+    // inter scale nms
+    NonMaximumSuppression(total_bboxes, 0.7f, IoU, nms_methods[0]);
+    BoxRegression(total_bboxes, true);
+    if (region) {
+      // drop proposals centered outside region
+      vector<char> flags(total_bboxes.size());
+      for (size_t i = 0; i < total_bboxes.size(); i++) {
+        const _BBox & _bbox = total_bboxes[i];
+        flags[i] = region->Contains((_bbox.x1 + _bbox.x2) / 2, (_bbox.y1 + _bbox.y2) / 2);
+      }
+      KeepFlagged(total_bboxes, flags);
+    }
   }
-  return pad;
 }
 
-vector<Mtcnn::_BBox> Mtcnn::ProposalNetwork(const ncnn::Mat & image)
+vector<Mtcnn::_BBox> Mtcnn::ScaleNetwork(Mtcnn::Context & ctx, const Mtcnn::_Image & image,
+  float scale, ncnn::Mat & input, const Mtcnn::_Region * region)
 {
-  int min_len = std::min<int>(image.w, image.h);
-  vector<float> scales = ScalePyramid(min_len);
+  int width = static_cast<int>(ceil(image.w * scale));
+  int height = static_cast<int>(ceil(image.h * scale));
+  ncnn::Mat threshold(1, 4u, &ctx.allocator);
+  threshold[0] = thresholds[0];
+  // the whole level, or its parts seen from region
+  vector<Roi> crops = region ? region->LevelCrops(scale, width, height)
+    : vector<Roi>(1, Roi(0, 0, width, height));
+  vector<_BBox> _bboxes;
+  for (const Roi & crop : crops) {
+    image.Warp(0, 0, image.w, image.h, width, height, crop, input, &ctx.allocator);
+    ncnn::Extractor ex = CreateExtractor(ctx, Pnet);
+    ex.input(det1_head_param_id::BLOB_data, input);
+    ex.input(det1_head_param_id::BLOB_threshold, threshold);
+    ncnn::Mat candidates;
+    ex.extract(det1_head_param_id::BLOB_candidates, candidates);
+    // cell (j, i) of crop is cell (j + x1 / 2, i + y1 / 2) of level
+    vector<_BBox> crop_bboxes = GetCandidates(scale, candidates, -crop.x1 / 2, -crop.y1 / 2);
+    _bboxes.insert(_bboxes.end(), crop_bboxes.begin(), crop_bboxes.end());
+  }
+  // intra scale nms
+  NonMaximumSuppression(_bboxes, 0.5f, IoU, nms_methods[0]);
+  return _bboxes;
+}
+
+vector<Mtcnn::_BBox> Mtcnn::MosaicNetwork(Mtcnn::Context & ctx, const Mtcnn::_Image & image, const vector<float> & scales)
+{
+  if (scales.empty())
+    return vector<_BBox>();
+  // guard gap covers the 12x12 receptive field of Pnet
+  const int gap = 12;
+  int levels = static_cast<int>(scales.size());
+  vector<int> widths(levels), heights(levels), xs(levels), ys(levels);
+  for (int l = 0; l < levels; l++) {
+    widths[l] = static_cast<int>(ceil(image.w * scales[l]));
+    heights[l] = static_cast<int>(ceil(image.h * scales[l]));
+  }
+  // next-fit shelves as wide as the two largest levels,
+  // offsets are kept even to align with the stride of pool1.
+  int canvas_w = levels > 1 ? ((widths[0] + gap + 1) & ~1) + widths[1] : widths[0];
+  int x = 0, y = 0, shelf_h = 0;
+  for (int l = 0; l < levels; l++) {
+    if (x > 0 && x + widths[l] > canvas_w) {
+      x = 0;
+      y = (y + shelf_h + gap + 1) & ~1;
+      shelf_h = 0;
+    }
+    xs[l] = x;
+    ys[l] = y;
+    x = (x + widths[l] + gap + 1) & ~1;
+    shelf_h = std::max<int>(shelf_h, heights[l]);
+  }
+  int canvas_h = y + shelf_h;
+
+  // mask marks conv1 outputs which lie inside a single level
+  ncnn::Mat & canvas = ctx.canvas;
+  ncnn::Mat & mask = ctx.mask;
+  canvas.create(canvas_w, canvas_h, image.c, 4u, &ctx.allocator);
+  mask.create(canvas_w - 2, canvas_h - 2, 1, 4u, &ctx.allocator);
+  canvas.fill(0.f);
+  mask.fill(0.f);
+  for (int l = 0; l < levels; l++) {
+    ncnn::Mat level;
+    image.Warp(0, 0, image.w, image.h, level, widths[l], heights[l], &ctx.allocator);
+    for (int q = 0; q < image.c; q++) {
+      const ncnn::Mat src = level.channel(q);
+      ncnn::Mat dst = canvas.channel(q);
+      for (int i = 0; i < heights[l]; i++)
+        memcpy(dst.row(ys[l] + i) + xs[l], src.row(i), widths[l] * sizeof(float));
+    }
+    for (int i = 0; i < heights[l] - 2; i++)
+      std::fill(mask.row(ys[l] + i) + xs[l], mask.row(ys[l] + i) + xs[l] + widths[l] - 2, 1.f);
+  }
+
+  ncnn::Mat threshold(1, 4u, &ctx.allocator);
+  threshold[0] = thresholds[0];
+  ncnn::Extractor ex = CreateExtractor(ctx, PnetMosaic);
+  ex.input(det1_mosaic_param_id::BLOB_data, canvas);
+  ex.input(det1_mosaic_param_id::BLOB_mask, mask);
+  ex.input(det1_mosaic_param_id::BLOB_threshold, threshold);
+  ncnn::Mat candidates;
+  ex.extract(det1_mosaic_param_id::BLOB_candidates, candidates);
+
   vector<_BBox> total_bboxes;
-#ifdef USE_OPENMP
-  #pragma omp parallel for
-#endif
-  for (float scale : scales) {
-    int width = static_cast<int>(ceil(image.w * scale));
-    int height = static_cast<int>(ceil(image.h * scale));
-    ncnn::Mat input;
-    ncnn::resize_bilinear(image, input, width, height);
-    ncnn::Extractor ex = Pnet.create_extractor();
-    ex.input("data", input);
-    ncnn::Mat conf_blob, loc_blob;
-    ex.extract("prob1", conf_blob);
-    ex.extract("conv4-2", loc_blob);
-    vector<_BBox> scale_bboxes = GetCandidates(scale, conf_blob, loc_blob);
+  for (int l = 0; l < levels; l++) {
+    // map size of a single level: conv1 -> pool1 (ceil) -> conv2 -> conv3
+    int map_w = (widths[l] - 4 + 1) / 2 + 1 - 4;
+    int map_h = (heights[l] - 4 + 1) / 2 + 1 - 4;
+    vector<_BBox> scale_bboxes = GetCandidates(scales[l], candidates,
+      xs[l] / 2, ys[l] / 2, map_w, map_h);
     // intra scale nms
-    NonMaximumSuppression(scale_bboxes, 0.5f, IoU);
+    NonMaximumSuppression(scale_bboxes, 0.5f, IoU, nms_methods[0]);
     if (!scale_bboxes.empty()) {
       total_bboxes.insert(total_bboxes.end(), scale_bboxes.begin(), scale_bboxes.end());
     }
   }
-  // inter scale nms
-  NonMaximumSuppression(total_bboxes, 0.7f, IoU);
-  BoxRegression(total_bboxes, true);
   return total_bboxes;
 }
 
-void Mtcnn::RefineNetwork(const ncnn::Mat & image, vector<Mtcnn::_BBox> & _bboxes)
+void Mtcnn::RefineNetwork(Mtcnn::Context & ctx, const Mtcnn::_Image & image, vector<Mtcnn::_BBox> & _bboxes)
+{
+  vector<_Image> images(1, image);
+  vector<vector<_BBox>> image_bboxes(1);
+  image_bboxes[0].swap(_bboxes);
+  RefineNetwork(ctx, images, image_bboxes);
+  _bboxes.swap(image_bboxes[0]);
+}
+
+void Mtcnn::RefineNetwork(Mtcnn::Context & ctx, const vector<Mtcnn::_Image> & images,
+  vector<vector<Mtcnn::_BBox>> & _bboxes)
 {
-  if (_bboxes.empty())
+  vector<_BBox> all;
+  vector<int> owners;
+  Gather(_bboxes, all, owners);
+  if (all.empty())
     return;
 
-  vector<int> keep;
-#ifdef USE_OPENMP
-   #pragma omp parallel for
-#endif
-  for (int i = 0; i < _bboxes.size(); i++) {
-    _BBox & _bbox = _bboxes[i];
-    ncnn::Mat pad = PadCrop(image, _bbox.x1, _bbox.y1, _bbox.x2, _bbox.y2);
-    ncnn::Mat input;
-    ncnn::resize_bilinear(pad, input, 24, 24);
-    ncnn::Extractor ex = Rnet.create_extractor();
-    ex.input("data", input);
-    ncnn::Mat conf_blob, loc_blob;
-    ex.extract("prob1", conf_blob);
-    ex.extract("fc5-2", loc_blob);
-    float score = conf_blob.channel(0)[1];
-    if (score >= thresholds[1]) {
-      _bbox.score = score;
-      for (int j = 0; j < 4; j++)
-        _bbox.regs[j] = loc_blob.channel(0)[j];
-      keep.push_back(i);
-    }
+  // survivors are flagged by index, so any thread order gives the same result
+  int total = static_cast<int>(all.size());
+  vector<char> flags(total, 0);
+  if (batch_size != 1) {
+    int batch = batch_size > 0 ? batch_size : total;
+    int chunks = (total + batch - 1) / batch;
+    if (ctx.stacks.size() < chunks)
+      ctx.stacks.resize(chunks);
+    ParallelFor(chunks, [&](int c) {
+      int begin = c * batch;
+      int count = std::min<int>(batch, total - begin);
+      StackCrops(images, owners, all, begin, count, 24, ctx.stacks[c], &ctx.allocator);
+      ncnn::Extractor ex = CreateExtractor(ctx, RnetBatch);
+      ex.input(det2_batch_param_id::BLOB_data, ctx.stacks[c]);
+      // one column per candidate
+      ncnn::Mat conf_blob, loc_blob;
+      ex.extract(det2_batch_param_id::BLOB_prob1, conf_blob);
+      ex.extract(det2_batch_param_id::BLOB_fc5_2, loc_blob);
+      for (int k = 0; k < count; k++) {
+        float score = conf_blob.channel(1)[k];
+        if (score >= thresholds[1]) {
+          _BBox & _bbox = all[begin + k];
+          _bbox.score = score;
+          for (int j = 0; j < 4; j++)
+            _bbox.regs[j] = loc_blob.channel(j)[k];
+          flags[begin + k] = 1;
+        }
+      }
+    });
   }
-  if (keep.size() < _bboxes.size()) {
-    for (int i = 0; i < keep.size(); i++) {
-      if (i < keep[i])
-        _bboxes[i] = _bboxes[keep[i]];
-    }
-    _bboxes.erase(_bboxes.begin() + keep.size(), _bboxes.end());
+  else {
+    ParallelFor(total, [&](int i) {
+      _BBox & _bbox = all[i];
+      ncnn::Mat input;
+      images[owners[i]].Warp(_bbox.x1, _bbox.y1, _bbox.x2, _bbox.y2, input, 24, 24, &ctx.allocator);
+      ncnn::Extractor ex = CreateExtractor(ctx, Rnet);
+      ex.input(det2_param_id::BLOB_data, input);
+      ncnn::Mat conf_blob, loc_blob;
+      ex.extract(det2_param_id::BLOB_prob1, conf_blob);
+      ex.extract(det2_param_id::BLOB_fc5_2, loc_blob);
+      float score = conf_blob.channel(0)[1];
+      if (score >= thresholds[1]) {
+        _bbox.score = score;
+        for (int j = 0; j < 4; j++)
+          _bbox.regs[j] = loc_blob.channel(0)[j];
+        flags[i] = 1;
+      }
+    });
+  }
+  Scatter(all, flags, owners, _bboxes);
+
+  for (vector<_BBox> & image_bboxes : _bboxes) {
+    NonMaximumSuppression(image_bboxes, 0.7f, IoU, nms_methods[1]);
+    BoxRegression(image_bboxes, true);
   }
+}
 
-  NonMaximumSuppression(_bboxes, 0.7f, IoU);
-  BoxRegression(_bboxes, true);
+void Mtcnn::OutputNetwork(Mtcnn::Context & ctx, const Mtcnn::_Image & image, vector<Mtcnn::_BBox> & _bboxes)
+{
+  vector<_Image> images(1, image);
+  vector<vector<_BBox>> image_bboxes(1);
+  image_bboxes[0].swap(_bboxes);
+  OutputNetwork(ctx, images, image_bboxes);
+  _bboxes.swap(image_bboxes[0]);
 }
 
-void Mtcnn::OutputNetwork(const ncnn::Mat & image, vector<Mtcnn::_BBox> & _bboxes)
+void Mtcnn::OutputNetwork(Mtcnn::Context & ctx, const vector<Mtcnn::_Image> & images,
+  vector<vector<Mtcnn::_BBox>> & _bboxes)
 {
-  if (_bboxes.empty())
+  vector<_BBox> all;
+  vector<int> owners;
+  Gather(_bboxes, all, owners);
+  if (all.empty())
     return;
 
-  vector<int> keep;
-#ifdef USE_OPENMP
-  #pragma omp parallel for
-#endif
-  for (int i = 0; i < _bboxes.size(); i++) {
-    _BBox & _bbox = _bboxes[i];
-    ncnn::Mat pad = PadCrop(image, _bbox.x1, _bbox.y1, _bbox.x2, _bbox.y2);
-    ncnn::Mat input;
-    ncnn::resize_bilinear(pad, input, 48, 48);
-    ncnn::Extractor ex = Onet.create_extractor();
-    ex.input("data", input);
-    ncnn::Mat conf_blob, loc_blob, kpt_blob;
-    ex.extract("prob1", conf_blob);
-    ex.extract("fc6-2", loc_blob);
-    ex.extract("fc6-3", kpt_blob);
-    float score = conf_blob.channel(0)[1];
-    if (score >= thresholds[2]) {
-      _bbox.score = score;
-      for (int j = 0; j < 4; j++)
-        _bbox.regs[j] = loc_blob.channel(0)[j];
-      // facial landmarks
-      int w = _bbox.x2 - _bbox.x1;
-      int h = _bbox.y2 - _bbox.y1;
-      for (int j = 0; j < 5; j++) {
-        _bbox.fpoints[j] = kpt_blob.channel(0)[j] * w + _bbox.x1;
-        _bbox.fpoints[j + 5] = kpt_blob.channel(0)[j + 5] * h + _bbox.y1;
+  int total = static_cast<int>(all.size());
+  vector<char> flags(total, 0);
+  if (batch_size != 1) {
+    int batch = batch_size > 0 ? batch_size : total;
+    int chunks = (total + batch - 1) / batch;
+    if (ctx.stacks.size() < chunks)
+      ctx.stacks.resize(chunks);
+    ParallelFor(chunks, [&](int c) {
+      int begin = c * batch;
+      int count = std::min<int>(batch, total - begin);
+      StackCrops(images, owners, all, begin, count, 48, ctx.stacks[c], &ctx.allocator);
+      ncnn::Extractor ex = CreateExtractor(ctx, OnetBatch);
+      ex.input(det3_batch_param_id::BLOB_data, ctx.stacks[c]);
+      // one column per candidate
+      ncnn::Mat conf_blob, loc_blob, kpt_blob;
+      ex.extract(det3_batch_param_id::BLOB_prob1, conf_blob);
+      ex.extract(det3_batch_param_id::BLOB_fc6_2, loc_blob);
+      ex.extract(det3_batch_param_id::BLOB_fc6_3, kpt_blob);
+      for (int k = 0; k < count; k++) {
+        float score = conf_blob.channel(1)[k];
+        if (score >= thresholds[2]) {
+          _BBox & _bbox = all[begin + k];
+          _bbox.score = score;
+          for (int j = 0; j < 4; j++)
+            _bbox.regs[j] = loc_blob.channel(j)[k];
+          // facial landmarks
+          int w = _bbox.x2 - _bbox.x1;
+          int h = _bbox.y2 - _bbox.y1;
+          for (int j = 0; j < 5; j++) {
+            _bbox.fpoints[j] = kpt_blob.channel(j)[k] * w + _bbox.x1;
+            _bbox.fpoints[j + 5] = kpt_blob.channel(j + 5)[k] * h + _bbox.y1;
+          }
+          flags[begin + k] = 1;
+        }
       }
-      keep.push_back(i);
-    }
+    });
   }
-  if (keep.size() < _bboxes.size()) {
-    for (int i = 0; i < keep.size(); i++) {
-      if (i < keep[i])
-        _bboxes[i] = _bboxes[keep[i]];
-    }
-    _bboxes.erase(_bboxes.begin() + keep.size(), _bboxes.end());
+  else {
+    ParallelFor(total, [&](int i) {
+      _BBox & _bbox = all[i];
+      ncnn::Mat input;
+      images[owners[i]].Warp(_bbox.x1, _bbox.y1, _bbox.x2, _bbox.y2, input, 48, 48, &ctx.allocator);
+      ncnn::Extractor ex = CreateExtractor(ctx, Onet);
+      ex.input(det3_param_id::BLOB_data, input);
+      ncnn::Mat conf_blob, loc_blob, kpt_blob;
+      ex.extract(det3_param_id::BLOB_prob1, conf_blob);
+      ex.extract(det3_param_id::BLOB_fc6_2, loc_blob);
+      ex.extract(det3_param_id::BLOB_fc6_3, kpt_blob);
+      float score = conf_blob.channel(0)[1];
+      if (score >= thresholds[2]) {
+        _bbox.score = score;
+        for (int j = 0; j < 4; j++)
+          _bbox.regs[j] = loc_blob.channel(0)[j];
+        // facial landmarks
+        int w = _bbox.x2 - _bbox.x1;
+        int h = _bbox.y2 - _bbox.y1;
+        for (int j = 0; j < 5; j++) {
+          _bbox.fpoints[j] = kpt_blob.channel(0)[j] * w + _bbox.x1;
+          _bbox.fpoints[j + 5] = kpt_blob.channel(0)[j + 5] * h + _bbox.y1;
+        }
+        flags[i] = 1;
+      }
+    });
   }
+  Scatter(all, flags, owners, _bboxes);
 
-  BoxRegression(_bboxes, false);
-  NonMaximumSuppression(_bboxes, 0.7f, IoM);
+  for (vector<_BBox> & image_bboxes : _bboxes) {
+    BoxRegression(image_bboxes, false);
+    NonMaximumSuppression(image_bboxes, 0.7f, IoM, nms_methods[2]);
+  }
+}
+
+void Mtcnn::LandmarkNetwork(Mtcnn::Context & ctx, const Mtcnn::_Image & image, vector<Mtcnn::_BBox> & _bboxes)
+{
+  vector<_Image> images(1, image);
+  vector<vector<_BBox>> image_bboxes(1);
+  image_bboxes[0].swap(_bboxes);
+  LandmarkNetwork(ctx, images, image_bboxes);
+  _bboxes.swap(image_bboxes[0]);
 }
 
-void Mtcnn::LandmarkNetwork(const ncnn::Mat & image, vector<Mtcnn::_BBox> & _bboxes)
+void Mtcnn::LandmarkNetwork(Mtcnn::Context & ctx, const vector<Mtcnn::_Image> & images,
+  vector<vector<Mtcnn::_BBox>> & _bboxes)
 {
-  if (_bboxes.empty())
+  vector<_BBox> all;
+  vector<int> owners;
+  Gather(_bboxes, all, owners);
+  if (all.empty())
     return;
 
-#ifdef USE_OPENMP
-  #pragma omp parallel for
-#endif
-  for (auto & _bbox : _bboxes) {
+  ParallelFor(static_cast<int>(all.size()), [&](int k) {
+    _BBox & _bbox = all[k];
+    const _Image & image = images[owners[k]];
     int patchw = std::max<int>(_bbox.x2 - _bbox.x1, _bbox.y2 - _bbox.y1);
     patchw = fix(patchw * 0.25f);
     if (patchw % 2 == 1)
       patchw += 1;
     ncnn::Mat input;
-    input.create(24, 24, image.c * 5, image.elemsize);
+    input.create(24, 24, image.c * 5, 4u, &ctx.allocator);
     for (int i = 0; i < 5; i++) {
       _bbox.fpoints[i] = round(_bbox.fpoints[i]);
       _bbox.fpoints[i+5] = round(_bbox.fpoints[i+5]);
@@ -341,18 +1034,17 @@ void Mtcnn::LandmarkNetwork(const ncnn::Mat & image, vector<Mtcnn::_BBox> & _bbo
       int y1 = fix(_bbox.fpoints[i+5]) - patchw / 2;
       int x2 = x1 + patchw;
       int y2 = y1 + patchw;
-      ncnn::Mat pad = PadCrop(image, x1, y1, x2, y2);
       ncnn::Mat channels = input.channel_range(image.c * i, image.c);
-      ncnn::resize_bilinear(pad, channels, 24, 24);
+      image.Warp(x1, y1, x2, y2, channels, 24, 24, &ctx.allocator);
     }
-    ncnn::Extractor ex = Lnet.create_extractor();
-    ex.input("data", input);
+    ncnn::Extractor ex = CreateExtractor(ctx, Lnet);
+    ex.input(det4_param_id::BLOB_data, input);
     vector<ncnn::Mat> blobs(5);
-    ex.extract("fc5_1", blobs[0]);
-    ex.extract("fc5_2", blobs[1]);
-    ex.extract("fc5_3", blobs[2]);
-    ex.extract("fc5_4", blobs[3]);
-    ex.extract("fc5_5", blobs[4]);
+    ex.extract(det4_param_id::BLOB_fc5_1, blobs[0]);
+    ex.extract(det4_param_id::BLOB_fc5_2, blobs[1]);
+    ex.extract(det4_param_id::BLOB_fc5_3, blobs[2]);
+    ex.extract(det4_param_id::BLOB_fc5_4, blobs[3]);
+    ex.extract(det4_param_id::BLOB_fc5_5, blobs[4]);
     for (int i = 0; i < 5; i++) {
       float off_x = blobs[i].channel(0)[0] - 0.5f;
       float off_y = blobs[i].channel(0)[1] - 0.5f;
@@ -362,5 +1054,31 @@ void Mtcnn::LandmarkNetwork(const ncnn::Mat & image, vector<Mtcnn::_BBox> & _bbo
         _bbox.fpoints[i+5] += off_y * patchw;
       }
     }
+  });
+  Scatter(all, vector<char>(all.size(), 1), owners, _bboxes);
+}
+
+vector<BBox> Mtcnn::Cascade(Mtcnn::Context & ctx, const Mtcnn::_Image & image, vector<Mtcnn::_BBox> & _bboxes)
+{
+  vector<_Image> images(1, image);
+  vector<vector<_BBox>> image_bboxes(1);
+  image_bboxes[0].swap(_bboxes);
+  vector<vector<BBox>> bboxes = Cascade(ctx, images, image_bboxes);
+  _bboxes.swap(image_bboxes[0]);
+  return bboxes[0];
+}
+
+vector<vector<BBox>> Mtcnn::Cascade(Mtcnn::Context & ctx, const vector<Mtcnn::_Image> & images,
+  vector<vector<Mtcnn::_BBox>> & _bboxes)
+{
+  RefineNetwork(ctx, images, _bboxes);
+  OutputNetwork(ctx, images, _bboxes);
+  if (precise_landmark && lnet)
+    LandmarkNetwork(ctx, images, _bboxes);
+  vector<vector<BBox>> bboxes(images.size());
+  for (size_t i = 0; i < images.size(); i++) {
+    for (const _BBox & _bbox : _bboxes[i])
+      bboxes[i].emplace_back(_bbox.base());
   }
+  return bboxes;
 }
@@ -1,11 +1,65 @@
 #ifndef FACE_MTCNN_H_
 #define FACE_MTCNN_H_
 
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
 // ncnn
 #include "net.h"
+#include "frame_allocator.h"
+#include "mapped_file.h"
+#include "nms.h"
 
 namespace face
 {
+class ThreadPool;
+class PipelineDetector;
+
+// Layout of u8 pixels.
+enum PixelFormat {
+  PIXEL_BGR,
+  PIXEL_RGB,
+  PIXEL_BGRA,
+  PIXEL_RGBA,
+  PIXEL_GRAY,  // one byte, seen as B = G = R
+  // YUV 4:2:0, one U and V for each 2 x 2 pixels
+  PIXEL_NV21,  // Y plane, then V/U interleaved plane
+  PIXEL_NV12,  // Y plane, then U/V interleaved plane
+  PIXEL_I420   // Y plane, then U plane, then V plane
+};
+
+// Pixels owned by caller, read in place by detector: nothing is converted
+// or copied up front, pyramid levels and crops sample the bytes lazily.
+class ImageView {
+public:
+  /// @brief Constructor, rows stride bytes apart. Chroma planes of YUV
+  /// follow Y plane, rows stride bytes apart for NV21/NV12, stride / 2 for I420.
+  explicit ImageView(const unsigned char* data, int width, int height, int stride,
+    PixelFormat format = PIXEL_BGR);
+  /// @brief Constructor of YUV with planes apart, e.g. from camera or decoder.
+  /// @brief u, v: first U and V, in NV21 v is the V/U plane and u = v + 1.
+  explicit ImageView(const unsigned char* y, const unsigned char* u, const unsigned char* v,
+    int width, int height, int stride, int uv_stride, PixelFormat format);
+
+  const unsigned char* data;  // pixels, or Y plane
+  const unsigned char* u;     // U plane of YUV
+  const unsigned char* v;     // V plane of YUV
+  int width, height;
+  int stride;     // bytes between rows
+  int uv_stride;  // bytes between U/V rows of YUV
+  PixelFormat format;
+};
+
+// Region of interest [x1, x2) x [y1, y2) of image.
+class Roi {
+public:
+  Roi() : x1(0), y1(0), x2(0), y2(0) {}
+  Roi(int x1, int y1, int x2, int y2) : x1(x1), y1(y1), x2(x2), y2(y2) {}
+
+  int x1, y1, x2, y2;
+};
+
 // Bounding box for hold score, box and facial points
 class BBox {
 public:
@@ -30,26 +84,83 @@ class BBoxReg {
   float x1, y1, x2, y2;
 };
 
+// Detect/Landmark/Refine may be called from many threads at once on one
+// instance: models are loaded once and every call works in its own context.
+// Settings below must not be changed while calls are running.
+// Nets take raw 0..255 pixels: MTCNN's (x - 127.5) * 0.0078125 is folded
+// into conv1 weights and bias of models/det1-det4, so no image is
+// normalized before them.
 class Mtcnn
 {
 public:
   /// @brief Constructor.
+  /// @brief model_dir: float models, or copies of them made by
+  /// Int8Calibrator or SaveHalfModel. Empty for the models compiled in
+  /// when built with MTCNN_EMBED_MODELS.
   /// @brief Lnet: whether to load Lnet.
-  Mtcnn(const std::string & model_dir, bool Lnet = true);
+  /// @brief map_models: map the .bin files of model_dir read-only and use
+  /// their weights in place, shared by all nets and processes loading them,
+  /// instead of reading a private copy into each net.
+  Mtcnn(const std::string & model_dir, bool Lnet = true, bool map_models = true);
   ~Mtcnn();
   /// @brief Detect faces from image
   std::vector<BBox> Detect(const ncnn::Mat & image);
+  /// @brief Detect faces from pixels of view, no float copy of image is made.
+  std::vector<BBox> Detect(const ImageView & image);
+  /// @brief Detect faces from u8 pixels, rows stride bytes apart.
+  std::vector<BBox> Detect(const unsigned char* pixels, int width, int height,
+    int stride, PixelFormat format = PIXEL_BGR);
+  /// @brief Detect faces centered in regions of interest only.
+  /// Pnet runs on the parts of pyramid levels its window may see from the
+  /// regions, so the cost follows their area, not the image one, and
+  /// proposals centered outside them are dropped before Rnet.
+  /// Pyramid mosaic is not used.
+  std::vector<BBox> Detect(const ncnn::Mat & image, const std::vector<Roi> & rois);
+  std::vector<BBox> Detect(const ImageView & image, const std::vector<Roi> & rois);
+  /// @brief Detect faces centered in mask only, a PIXEL_GRAY view of
+  /// image size, nonzero where to detect. Tiles of mask all 0 are skipped,
+  /// the others are the regions of interest.
+  std::vector<BBox> Detect(const ncnn::Mat & image, const ImageView & mask);
+  std::vector<BBox> Detect(const ImageView & image, const ImageView & mask);
+  /// @brief Detect faces of many images, faces of images[i] at i, the same
+  /// as Detect(images[i]) gives. Pnet runs on the scales of all images at
+  /// once, then R/O/Lnet on candidates of all images, sharing batches.
+  std::vector<std::vector<BBox>> DetectBatch(const std::vector<ImageView> & images);
+  /// @brief Detect the k largest faces, largest first.
+  /// Scales run from large faces to small ones, each through P/R/Onet, and
+  /// stop once k faces are found no smaller than the Pnet window of the
+  /// next scale. Pyramid mosaic is not used.
+  std::vector<BBox> DetectLargest(const ncnn::Mat & image, int k = 1);
+  std::vector<BBox> DetectLargest(const ImageView & image, int k = 1);
   /// @brief Get facial points of detect face by O/Lnet
   BBox Landmark(const ncnn::Mat & image, BBox bbox = BBox());
+  /// @brief Detect faces from given proposals by R/O/Lnet, skipping Pnet.
+  std::vector<BBox> Refine(const ncnn::Mat & image, const std::vector<BBox> & proposals);
+  std::vector<BBox> Refine(const ImageView & image, const std::vector<BBox> & proposals);
+  /// @brief Memory requests of temporaries in the last finished call.
+  FrameAllocator::Stats MemoryStats();
 
   // default settings
   int face_min_size = 40;
   int face_max_size = 500;
   float scale_factor = 0.709f;
   float thresholds[3] = {0.8f, 0.9f, 0.9f};
+  // nms of P/R/O-Net stage, all methods keep the same candidates,
+  // NMS_GRID is faster once there are thousands of them.
+  NmsMethod nms_methods[3] = {NMS_GRID, NMS_BITMASK, NMS_BITMASK};
   bool precise_landmark = true;
+  // candidates stacked in one R/O-Net forward:
+  // 1 for one forward per candidate, 0 for all candidates in one forward.
+  int batch_size = 1;
+  // pack all pyramid levels into one canvas and run Pnet once.
+  bool pyramid_mosaic = false;
+  // threads sharing scales and candidates of a stage, for all calls.
+  int num_threads = 1;
 
 private:
+  // runs the stages of frames on its own threads
+  friend class PipelineDetector;
+
   // Inter _BBox extend outer BBox with location regression offsets.
   class _BBox : public BBox {
   public:
@@ -71,37 +182,141 @@ private:
     }
   };
 
+  // Per-call state, reused by later calls through a pool:
+  // allocator of all temporaries and scratch buffers of inputs.
+  struct Context {
+    FrameAllocator allocator;
+    std::vector<ncnn::Mat> levels;  // pyramid levels
+    ncnn::Mat canvas, mask;         // pyramid mosaic
+    std::vector<ncnn::Mat> stacks;  // stacked crops of every chunk
+  };
+
+  // Image read by stages: planar float Mat, or u8 pixels of a view
+  // seen as planar BGR.
+  class _Image {
+  public:
+    explicit _Image(const ncnn::Mat & mat);
+    explicit _Image(const ImageView & view);
+    int w, h, c;
+    /// @brief Crop region with padding 0 and resize it to w x h,
+    /// channel q is written at dst + q * cstep.
+    void Warp(int x1, int y1, int x2, int y2, int w, int h,
+      float* dst, size_t cstep, ncnn::Allocator * allocator) const;
+    /// @brief Crop region with padding 0 and resize it into dst of w x h x c.
+    void Warp(int x1, int y1, int x2, int y2, ncnn::Mat & dst, int w, int h,
+      ncnn::Allocator * allocator) const;
+    /// @brief Only the window part of the w x h resize into dst.
+    void Warp(int x1, int y1, int x2, int y2, int w, int h, const Roi & window,
+      ncnn::Mat & dst, ncnn::Allocator * allocator) const;
+  private:
+    const ncnn::Mat * mat;
+    ImageView view;
+    bool yuv;
+    int step;        // bytes per interleaved pixel, or per U/V sample
+    int offsets[3];  // byte of B, G, R in interleaved pixel
+  };
+
+  // Where to detect: rectangles covering it, and mask pixels if any.
+  struct _Region {
+    std::vector<Roi> rois;
+    const ImageView * mask;
+    /// @brief Whether pixel (x, y) is to detect in.
+    bool Contains(int x, int y) const;
+    /// @brief Parts of the w x h level at scale which Pnet runs on, aligned
+    /// to pool1 so that they give the same candidates as the whole level.
+    std::vector<Roi> LevelCrops(float scale, int w, int h) const;
+  };
+
   enum NMS_TYPE {
     IoM,	// Intersection over Union
     IoU		// Intersection over Minimum
   };
 
+  // .bin files of model_dir by name, weights of the nets point into them
+  std::map<std::string, MappedFile> mapped_bins;
   // networks
   ncnn::Net Pnet, Rnet, Onet, Lnet;
+  // Pnet over pyramid mosaic, batched R/O-Net, share weights with Pnet/Rnet/Onet
+  ncnn::Net PnetMosaic, RnetBatch, OnetBatch;
   bool lnet;
+  // idle contexts
+  std::mutex pool_mutex;
+  std::vector<std::unique_ptr<Context>> pool;
+  // shared, so a call keeps its pool while another replaces it
+  std::shared_ptr<ThreadPool> workers;
+  FrameAllocator::Stats last_stats;
+
+  /// @brief Take an idle context from pool, or create a new one.
+  std::unique_ptr<Context> AcquireContext();
+  /// @brief Put context back to pool, keeping its memory stats.
+  void ReleaseContext(std::unique_ptr<Context> ctx);
+  /// @brief Create extractor drawing memory from context.
+  ncnn::Extractor CreateExtractor(Context & ctx, const ncnn::Net & net);
+  /// @brief Run func(0) .. func(n-1) on num_threads threads.
+  void ParallelFor(int n, const std::function<void(int)> & func);
 
   /// @brief Create scale pyramid: down order
   std::vector<float> ScalePyramid(const int min_len);
-  /// @brief Get bboxes from maps of confidences and regressions.
-  std::vector<_BBox> GetCandidates(const float scale,
-    const ncnn::Mat & conf_blob, const ncnn::Mat & loc_blob);
+  /// @brief Get bboxes from candidate cells of Pnet head.
+  /// @optional param x0, y0, w, h: region of map belonging to this scale,
+  /// cell (x0, y0) of map is cell (0, 0) of scale, w < 0 keeps any cell.
+  std::vector<_BBox> GetCandidates(const float scale, const ncnn::Mat & candidates,
+    int x0 = 0, int y0 = 0, int w = -1, int h = -1);
   /// @brief Non Maximum Supression with type 'IoU' or 'IoM'.
   void NonMaximumSuppression(std::vector<_BBox> & _bboxes,
-    const float threshold, const NMS_TYPE type);
+    const float threshold, const NMS_TYPE type, NmsMethod method = NMS_BITMASK);
   /// @brief Refine bounding box with regression
   /// @optional param square: where expand bbox to square.
   void BoxRegression(std::vector<_BBox> & _bboxes, bool square);
-  /// @brief Crop proposals with padding 0.
-  ncnn::Mat PadCrop(const ncnn::Mat & image, int x1, int y1, int x2, int y2);
+  /// @brief Keep bboxes with nonzero flag, in their original order.
+  void KeepFlagged(std::vector<_BBox> & _bboxes, const std::vector<char> & flags);
+  /// @brief Candidates of all images in one list, owners[k]: image of candidate k.
+  void Gather(std::vector<std::vector<_BBox>> & _bboxes, std::vector<_BBox> & all,
+    std::vector<int> & owners);
+  /// @brief Flagged candidates of list back to their images, in order.
+  void Scatter(std::vector<_BBox> & all, const std::vector<char> & flags,
+    const std::vector<int> & owners, std::vector<std::vector<_BBox>> & _bboxes);
+  /// @brief Crop and resize proposals, each from its owner image, stacked
+  /// vertically into one blob.
+  void StackCrops(const std::vector<_Image> & images, const std::vector<int> & owners,
+    const std::vector<_BBox> & _bboxes, int begin, int count, int size, ncnn::Mat & stack,
+    ncnn::Allocator * allocator = 0);
 
-  /// @brief Stage 1: Pnet get proposal bounding boxes
-  std::vector<_BBox> ProposalNetwork(const ncnn::Mat & image);
+  /// @brief Stage 1-4 on image, within region if any.
+  std::vector<BBox> Detect(const _Image & image, const _Region * region = 0);
+  /// @brief Stage 2-4 on proposals of image.
+  std::vector<BBox> Refine(const _Image & image, const std::vector<BBox> & proposals);
+  /// @brief Largest k faces of image.
+  std::vector<BBox> DetectLargest(const _Image & image, int k);
+  /// @brief Stage 1: Pnet get proposal bounding boxes, within region if any.
+  std::vector<_BBox> ProposalNetwork(Context & ctx, const _Image & image, const _Region * region = 0);
+  /// @brief Stage 1 on all scales of all images at once, proposals[i] of images[i].
+  void ProposalNetwork(Context & ctx, const std::vector<_Image> & images,
+    std::vector<std::vector<_BBox>> & proposals, const _Region * region = 0);
+  /// @brief Stage 1 on one scale, input holds the resized image, before inter scale nms.
+  /// Only crops of the resized image seen from region are run if given.
+  std::vector<_BBox> ScaleNetwork(Context & ctx, const _Image & image, float scale, ncnn::Mat & input,
+    const _Region * region = 0);
+  /// @brief Stage 1 on all scales packed into one mosaic, before inter scale nms.
+  std::vector<_BBox> MosaicNetwork(Context & ctx, const _Image & image, const std::vector<float> & scales);
   /// @brief Stage 2: Rnet refine and reject proposals
-  void RefineNetwork(const ncnn::Mat & image, std::vector<_BBox> & _bboxes);
+  void RefineNetwork(Context & ctx, const _Image & image, std::vector<_BBox> & _bboxes);
+  void RefineNetwork(Context & ctx, const std::vector<_Image> & images,
+    std::vector<std::vector<_BBox>> & _bboxes);
   /// @brief Stage 3: Onet refine and reject proposals and regress facial landmarks.
-  void OutputNetwork(const ncnn::Mat & image, std::vector<_BBox> & _bboxes);
+  void OutputNetwork(Context & ctx, const _Image & image, std::vector<_BBox> & _bboxes);
+  void OutputNetwork(Context & ctx, const std::vector<_Image> & images,
+    std::vector<std::vector<_BBox>> & _bboxes);
   /// @brief Stage 4: Lnet refine facial landmarks
-  void LandmarkNetwork(const ncnn::Mat & image, std::vector<_BBox> & _bboxes);
+  void LandmarkNetwork(Context & ctx, const _Image & image, std::vector<_BBox> & _bboxes);
+  void LandmarkNetwork(Context & ctx, const std::vector<_Image> & images,
+    std::vector<std::vector<_BBox>> & _bboxes);
+  /// @brief Stage 2-4: R/O/Lnet cascade on proposals.
+  std::vector<BBox> Cascade(Context & ctx, const _Image & image, std::vector<_BBox> & _bboxes);
+  /// @brief Stage 2-4 on proposals of all images, candidates of all images
+  /// share batches and threads, each stage keeps its nms per image.
+  std::vector<std::vector<BBox>> Cascade(Context & ctx, const std::vector<_Image> & images,
+    std::vector<std::vector<_BBox>> & _bboxes);
 };	// class MTCNN
 
 } // namespace face
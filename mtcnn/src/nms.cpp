@@ -0,0 +1,210 @@
+#include <algorithm>  // std::sort, std::fill, std::min, std::max
+#include <climits>    // INT_MIN, INT_MAX
+#include <cmath>      // sqrt
+#include <numeric>    // std::iota
+
+#include "kernels.h"
+#include "nms.h"
+using namespace std;
+using namespace face;
+
+namespace
+{
+// Overlap of box m with box b, as Mtcnn has always computed it.
+inline bool Overlapped(int mx1, int my1, int mx2, int my2, int marea,
+  int bx1, int by1, int bx2, int by2, int barea, float threshold, bool min_overlap)
+{
+  int x1 = std::max<int>(mx1, bx1);
+  int y1 = std::max<int>(my1, by1);
+  int x2 = std::min<int>(mx2, bx2);
+  int y2 = std::min<int>(my2, by2);
+  float overlap = 0.f;
+  if (x1 < x2 && y1 < y2) {
+    int inter = (x2 - x1) * (y2 - y1);
+    int outer = min_overlap ? std::min<int>(marea, barea) : marea + barea - inter;
+    overlap = static_cast<float>(inter) / outer;
+  }
+  return overlap > threshold;
+}
+
+// Division rounding toward minus infinity.
+inline int FloorDiv(int64_t a, int b)
+{
+  int64_t q = a / b;
+  if (a % b != 0 && a < 0)
+    --q;
+  return static_cast<int>(std::max<int64_t>(std::min<int64_t>(q, INT_MAX), INT_MIN));
+}
+} // namespace
+
+void NmsBoxes::push_back(int x1, int y1, int x2, int y2, float score)
+{
+  x1s.push_back(x1);
+  y1s.push_back(y1);
+  x2s.push_back(x2);
+  y2s.push_back(y2);
+  scores.push_back(score);
+}
+
+void NmsBoxes::clear()
+{
+  x1s.clear();
+  y1s.clear();
+  x2s.clear();
+  y2s.clear();
+  scores.clear();
+}
+
+vector<int> NmsBoxes::Suppress(float threshold, bool min_overlap, NmsMethod method)
+{
+  int n = size();
+  order.resize(n);
+  iota(order.begin(), order.end(), 0);
+  sort(order.begin(), order.end(), [this](int a, int b) {
+    return scores[a] > scores[b] || (scores[a] == scores[b] && a < b);
+  });
+
+  // Padding boxes are empty, they never overlap and are never visited.
+  int padded = (n + kKernelPad - 1) / kKernelPad * kKernelPad;
+  sx1.assign(padded, 0);
+  sy1.assign(padded, 0);
+  sx2.assign(padded, 0);
+  sy2.assign(padded, 0);
+  areas.assign(padded, 0);
+  for (int k = 0; k < n; k++) {
+    int i = order[k];
+    sx1[k] = x1s[i];
+    sy1[k] = y1s[i];
+    sx2[k] = x2s[i];
+    sy2[k] = y2s[i];
+    areas[k] = (x2s[i] - x1s[i]) * (y2s[i] - y1s[i]);
+  }
+  suppressed.assign((padded + 63) / 64, 0);
+
+  // Boxes apart overlap by 0, with a negative threshold they count too.
+  bool nearby = method == NMS_GRID && threshold >= 0.f;
+  if (nearby)
+    BuildGrids(n);
+  const Kernels & kernels = GetKernels();
+  vector<int> keep;
+  for (int i = 0; i < n; i++) {
+    if ((suppressed[i >> 6] >> (i & 63)) & 1)
+      continue;
+    keep.push_back(order[i]);
+    if (nearby)
+      SuppressNearby(i, threshold, min_overlap);
+    else
+      kernels.suppress_all(sx1.data(), sy1.data(), sx2.data(), sy2.data(), areas.data(),
+        i, n, threshold, min_overlap, suppressed.data());
+  }
+  return keep;
+}
+
+void NmsBoxes::BuildGrids(int n)
+{
+  // size class of box: ceil(log2) of its larger side
+  vector<int> classes(n, -1);
+  vector<int> x_max, y_max;  // of top left corners in each grid
+  int grid_of_class[32];
+  std::fill(grid_of_class, grid_of_class + 32, -1);
+  grids.clear();
+  for (int k = 0; k < n; k++) {
+    int w = sx2[k] - sx1[k];
+    int h = sy2[k] - sy1[k];
+    // empty boxes overlap nothing
+    if (w <= 0 || h <= 0)
+      continue;
+    int side = std::max<int>(w, h);
+    int c = 0;
+    while (c < 31 && (1 << c) < side)
+      c++;
+    if (grid_of_class[c] < 0) {
+      grid_of_class[c] = static_cast<int>(grids.size());
+      grids.emplace_back();
+      grids.back().size = 0;
+      grids.back().x0 = grids.back().y0 = INT_MAX;
+      x_max.push_back(INT_MIN);
+      y_max.push_back(INT_MIN);
+    }
+    int g = grid_of_class[c];
+    Grid & grid = grids[g];
+    classes[k] = g;
+    grid.size = std::max<int>(grid.size, side);
+    grid.x0 = std::min<int>(grid.x0, sx1[k]);
+    grid.y0 = std::min<int>(grid.y0, sy1[k]);
+    x_max[g] = std::max<int>(x_max[g], sx1[k]);
+    y_max[g] = std::max<int>(y_max[g], sy1[k]);
+    grid.items.push_back(k);
+  }
+
+  for (size_t g = 0; g < grids.size(); g++) {
+    Grid & grid = grids[g];
+    // About as many cells as boxes, none smaller than the boxes.
+    int count = static_cast<int>(grid.items.size());
+    int limit = static_cast<int>(sqrt(static_cast<double>(count))) + 1;
+    int64_t width = (int64_t)x_max[g] - grid.x0 + 1;
+    int64_t height = (int64_t)y_max[g] - grid.y0 + 1;
+    grid.cell_w = static_cast<int>(std::max<int64_t>(grid.size, (width + limit - 1) / limit));
+    grid.cell_h = static_cast<int>(std::max<int64_t>(grid.size, (height + limit - 1) / limit));
+    grid.cols = static_cast<int>((width + grid.cell_w - 1) / grid.cell_w);
+    grid.rows = static_cast<int>((height + grid.cell_h - 1) / grid.cell_h);
+    grid.starts.assign(grid.cols * grid.rows + 1, 0);
+  }
+  // counting sort of boxes by cell, ascending positions within each cell
+  vector<int> cells(n, -1);
+  for (int k = 0; k < n; k++) {
+    if (classes[k] < 0)
+      continue;
+    Grid & grid = grids[classes[k]];
+    int col = static_cast<int>(((int64_t)sx1[k] - grid.x0) / grid.cell_w);
+    int row = static_cast<int>(((int64_t)sy1[k] - grid.y0) / grid.cell_h);
+    cells[k] = row * grid.cols + col;
+    grid.starts[cells[k] + 1]++;
+  }
+  for (Grid & grid : grids) {
+    for (size_t c = 1; c < grid.starts.size(); c++)
+      grid.starts[c] += grid.starts[c - 1];
+    grid.cursors.assign(grid.starts.begin(), grid.starts.end() - 1);
+  }
+  for (int k = 0; k < n; k++) {
+    if (classes[k] < 0)
+      continue;
+    Grid & grid = grids[classes[k]];
+    grid.items[grid.cursors[cells[k]]++] = k;
+  }
+  for (Grid & grid : grids)
+    grid.cursors.assign(grid.starts.begin(), grid.starts.end() - 1);
+}
+
+void NmsBoxes::SuppressNearby(int i, float threshold, bool min_overlap)
+{
+  int mx1 = sx1[i], my1 = sy1[i], mx2 = sx2[i], my2 = sy2[i];
+  if (mx1 >= mx2 || my1 >= my2)
+    return;
+  for (Grid & grid : grids) {
+    // Box b of grid meets box i only if b.x1 in (mx1 - size, mx2),
+    // and b.y1 in (my1 - size, my2).
+    int col0 = std::max<int>(FloorDiv((int64_t)mx1 - grid.size + 1 - grid.x0, grid.cell_w), 0);
+    int col1 = std::min<int>(FloorDiv((int64_t)mx2 - 1 - grid.x0, grid.cell_w), grid.cols - 1);
+    int row0 = std::max<int>(FloorDiv((int64_t)my1 - grid.size + 1 - grid.y0, grid.cell_h), 0);
+    int row1 = std::min<int>(FloorDiv((int64_t)my2 - 1 - grid.y0, grid.cell_h), grid.rows - 1);
+    for (int row = row0; row <= row1; row++) {
+      for (int col = col0; col <= col1; col++) {
+        int c = row * grid.cols + col;
+        int end = grid.starts[c + 1];
+        // boxes up to i are visited already, for this and later kept boxes
+        int & cursor = grid.cursors[c];
+        while (cursor < end && grid.items[cursor] <= i)
+          cursor++;
+        for (int t = cursor; t < end; t++) {
+          int j = grid.items[t];
+          if ((suppressed[j >> 6] >> (j & 63)) & 1)
+            continue;
+          if (Overlapped(mx1, my1, mx2, my2, areas[i],
+            sx1[j], sy1[j], sx2[j], sy2[j], areas[j], threshold, min_overlap))
+            suppressed[j >> 6] |= (uint64_t)1 << (j & 63);
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,66 @@
+#ifndef FACE_NMS_H_
+#define FACE_NMS_H_
+
+#include <cstdint>
+#include <vector>
+
+namespace face
+{
+// Ways to find the boxes overlapped by a kept one, both keep the same boxes.
+enum NmsMethod {
+  NMS_BITMASK,  // test every later box, a vector at once
+  NMS_GRID      // test boxes of neighbouring grid cells only
+};
+
+// Greedy non maximum suppression over boxes kept as structure of arrays.
+// Boxes are visited by descending score, each one kept drops the boxes
+// after it overlapping it by more than threshold. Overlaps of a kept box
+// are computed with a vector of boxes at once by Kernels::suppress_all, and
+// dropped boxes are marked in a bitmask, nothing is erased or moved while
+// suppressing.
+// NMS_GRID buckets boxes by size into grids with cells no smaller than the
+// boxes, so a kept box only meets boxes of the cells around it, and the
+// cost stays near linear in the number of boxes when they are many.
+class NmsBoxes
+{
+public:
+  /// @brief Add box, its index is the number of boxes added before.
+  void push_back(int x1, int y1, int x2, int y2, float score);
+  void clear();
+  int size() const { return static_cast<int>(scores.size()); }
+  /// @brief Suppress overlapped boxes.
+  /// @param min_overlap: intersection over minimum area, else over union.
+  /// @return indices of kept boxes, by descending score, equal scores by index.
+  std::vector<int> Suppress(float threshold, bool min_overlap,
+    NmsMethod method = NMS_BITMASK);
+
+private:
+  // Boxes of one size class, bucketed by cell of their top left corner.
+  struct Grid {
+    int size;              // no box is wider or higher
+    int x0, y0;            // top left of cell 0
+    int cell_w, cell_h;    // no smaller than size
+    int cols, rows;
+    std::vector<int> starts;  // boxes of cell c: items[starts[c] .. starts[c + 1])
+    std::vector<int> items;   // sorted positions of boxes, ascending
+    std::vector<int> cursors; // first item of cell not visited yet
+  };
+
+  /// @brief Bucket sorted boxes into grids.
+  void BuildGrids(int n);
+  /// @brief Test boxes after i against box i, with those of nearby cells.
+  void SuppressNearby(int i, float threshold, bool min_overlap);
+
+  // boxes as added
+  std::vector<int> x1s, y1s, x2s, y2s;
+  std::vector<float> scores;
+  // boxes by descending score, padded to a multiple of kKernelPad
+  std::vector<int> order;
+  std::vector<int> sx1, sy1, sx2, sy2, areas;
+  std::vector<uint64_t> suppressed;
+  std::vector<Grid> grids;
+};
+
+} // namespace face
+
+#endif // FACE_NMS_H_
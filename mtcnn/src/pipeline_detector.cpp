@@ -0,0 +1,258 @@
+#include <algorithm>  // std::max
+#include <cstring>    // memcpy
+
+#include "pipeline_detector.h"
+using namespace std;
+using namespace face;
+
+void PipelineDetector::Queue::Push(unique_ptr<PipelineDetector::Frame> frame)
+{
+  {
+    unique_lock<mutex> lock(frames_mutex);
+    not_full.wait(lock, [this]() { return frames.size() < capacity; });
+    frames.push_back(std::move(frame));
+  }
+  not_empty.notify_one();
+}
+
+unique_ptr<PipelineDetector::Frame> PipelineDetector::Queue::Pop()
+{
+  unique_ptr<Frame> frame;
+  {
+    unique_lock<mutex> lock(frames_mutex);
+    not_empty.wait(lock, [this]() { return closed || !frames.empty(); });
+    if (frames.empty())
+      return frame;
+    frame = std::move(frames.front());
+    frames.pop_front();
+  }
+  not_full.notify_one();
+  return frame;
+}
+
+void PipelineDetector::Queue::Close()
+{
+  {
+    lock_guard<mutex> lock(frames_mutex);
+    closed = true;
+  }
+  not_empty.notify_all();
+}
+
+PipelineDetector::PipelineDetector(Mtcnn & mtcnn, const int* workers, int queue_size) :
+  mtcnn(mtcnn), capacity(0)
+{
+  queue_size = std::max<int>(queue_size, 1);
+  for (int s = 0; s < STAGE_COUNT; s++) {
+    running[s] = workers ? std::max<int>(workers[s], 1) : 1;
+    busy_ms[s] = 0;
+    stage_frames[s] = 0;
+    queues[s].reset(new Queue(queue_size));
+    // frames in queues and workers, so faces not popped stay bounded as well
+    capacity += queue_size + running[s];
+  }
+  for (int s = 0; s < STAGE_COUNT; s++) {
+    for (int i = 0; i < running[s]; i++)
+      threads[s].emplace_back(&PipelineDetector::Work, this, s);
+  }
+}
+
+PipelineDetector::~PipelineDetector()
+{
+  Close();
+  for (int s = 0; s < STAGE_COUNT; s++) {
+    for (auto & thread : threads[s])
+      thread.join();
+  }
+}
+
+void PipelineDetector::Push(const ncnn::Mat & frame)
+{
+  unique_ptr<Frame> copy(new Frame());
+  copy->mat = frame.clone();
+  copy->image.reset(new Mtcnn::_Image(copy->mat));
+  Start(std::move(copy));
+}
+
+// Copy pixels of view into pixels, rows and planes packed, and view them.
+static ImageView CopyView(const ImageView & view, vector<unsigned char> & pixels)
+{
+  int w = view.width, h = view.height;
+  if (view.format == PIXEL_NV21 || view.format == PIXEL_NV12 || view.format == PIXEL_I420) {
+    // one U and V for each 2 x 2 pixels, rounded up
+    int cw = (w + 1) / 2, ch = (h + 1) / 2;
+    bool planar = view.format == PIXEL_I420;
+    int uv_stride = planar ? cw : 2 * cw;
+    pixels.resize(w * h + (planar ? 2 : 1) * uv_stride * ch);
+    unsigned char* y = pixels.data();
+    unsigned char* uv = y + w * h;
+    for (int i = 0; i < h; i++)
+      memcpy(y + w * i, view.data + view.stride * i, w);
+    if (planar) {
+      for (int i = 0; i < ch; i++) {
+        memcpy(uv + cw * i, view.u + view.uv_stride * i, cw);
+        memcpy(uv + cw * (ch + i), view.v + view.uv_stride * i, cw);
+      }
+      return ImageView(y, uv, uv + cw * ch, w, h, w, uv_stride, view.format);
+    }
+    // interleaved plane starts at V for NV21, at U for NV12
+    const unsigned char* first = view.format == PIXEL_NV21 ? view.v : view.u;
+    for (int i = 0; i < ch; i++)
+      memcpy(uv + uv_stride * i, first + view.uv_stride * i, uv_stride);
+    if (view.format == PIXEL_NV21)
+      return ImageView(y, uv + 1, uv, w, h, w, uv_stride, view.format);
+    return ImageView(y, uv, uv + 1, w, h, w, uv_stride, view.format);
+  }
+  int step = view.format == PIXEL_GRAY ? 1
+    : view.format == PIXEL_BGR || view.format == PIXEL_RGB ? 3 : 4;
+  pixels.resize(w * h * step);
+  for (int i = 0; i < h; i++)
+    memcpy(pixels.data() + w * step * i, view.data + view.stride * i, w * step);
+  return ImageView(pixels.data(), w, h, w * step, view.format);
+}
+
+void PipelineDetector::Push(const ImageView & frame)
+{
+  unique_ptr<Frame> copy(new Frame());
+  copy->image.reset(new Mtcnn::_Image(CopyView(frame, copy->pixels)));
+  Start(std::move(copy));
+}
+
+void PipelineDetector::Start(unique_ptr<PipelineDetector::Frame> frame)
+{
+  {
+    unique_lock<mutex> lock(state_mutex);
+    state_cond.wait(lock, [this]() { return closed || pushed - popped < capacity; });
+    if (closed)
+      return;
+    frame->index = pushed++;
+    frame->pushed = Clock::now();
+    if (frame->index == 0)
+      first_push = frame->pushed;
+    starting++;
+  }
+  frame->ctx = mtcnn.AcquireContext();
+  queues[STAGE_PNET]->Push(std::move(frame));
+  {
+    lock_guard<mutex> lock(state_mutex);
+    starting--;
+  }
+  state_cond.notify_all();
+}
+
+bool PipelineDetector::Pop(vector<BBox> & faces)
+{
+  unique_lock<mutex> lock(state_mutex);
+  state_cond.wait(lock, [this]() {
+    return done.count(popped) > 0 || (closed && popped == pushed);
+  });
+  auto it = done.find(popped);
+  if (it == done.end())
+    return false;
+  faces.swap(it->second);
+  done.erase(it);
+  popped++;
+  state_cond.notify_all();
+  return true;
+}
+
+void PipelineDetector::Close()
+{
+  {
+    unique_lock<mutex> lock(state_mutex);
+    if (closed)
+      return;
+    closed = true;
+    state_cond.notify_all();
+    // frames pushed before must reach the Pnet queue before it closes
+    state_cond.wait(lock, [this]() { return starting == 0; });
+  }
+  queues[STAGE_PNET]->Close();
+}
+
+void PipelineDetector::Work(int stage)
+{
+  Queue & queue = *queues[stage];
+  for (unique_ptr<Frame> frame = queue.Pop(); frame; frame = queue.Pop()) {
+    Clock::time_point begin = Clock::now();
+    Run(stage, *frame);
+    double ms = chrono::duration<double, milli>(Clock::now() - begin).count();
+    {
+      lock_guard<mutex> lock(state_mutex);
+      busy_ms[stage] += ms;
+      stage_frames[stage]++;
+    }
+    if (stage + 1 < STAGE_COUNT)
+      queues[stage + 1]->Push(std::move(frame));
+    else
+      Finish(std::move(frame));
+  }
+  // the last worker of a stage stops the next stage
+  bool last;
+  {
+    lock_guard<mutex> lock(state_mutex);
+    last = --running[stage] == 0;
+  }
+  if (last && stage + 1 < STAGE_COUNT)
+    queues[stage + 1]->Close();
+}
+
+void PipelineDetector::Run(int stage, PipelineDetector::Frame & frame)
+{
+  Mtcnn::Context & ctx = *frame.ctx;
+  const Mtcnn::_Image & image = *frame.image;
+  switch (stage) {
+  case STAGE_PNET:
+    frame.bboxes = mtcnn.ProposalNetwork(ctx, image);
+    break;
+  case STAGE_RNET:
+    mtcnn.RefineNetwork(ctx, image, frame.bboxes);
+    break;
+  case STAGE_ONET:
+    mtcnn.OutputNetwork(ctx, image, frame.bboxes);
+    break;
+  case STAGE_LNET:
+    if (mtcnn.precise_landmark && mtcnn.lnet)
+      mtcnn.LandmarkNetwork(ctx, image, frame.bboxes);
+    break;
+  }
+}
+
+void PipelineDetector::Finish(unique_ptr<PipelineDetector::Frame> frame)
+{
+  vector<BBox> faces;
+  for (const Mtcnn::_BBox & _bbox : frame->bboxes)
+    faces.emplace_back(_bbox.base());
+  mtcnn.ReleaseContext(std::move(frame->ctx));
+  Clock::time_point now = Clock::now();
+  {
+    lock_guard<mutex> lock(state_mutex);
+    done[frame->index].swap(faces);
+    frames_done++;
+    latency_ms += chrono::duration<double, milli>(now - frame->pushed).count();
+    last_done = now;
+  }
+  state_cond.notify_all();
+}
+
+PipelineDetector::Stats PipelineDetector::stats()
+{
+  lock_guard<mutex> lock(state_mutex);
+  Stats stats;
+  double elapsed_ms = frames_done > 0
+    ? chrono::duration<double, milli>(last_done - first_push).count() : 0;
+  for (int s = 0; s < STAGE_COUNT; s++) {
+    StageStats & stage = stats.stages[s];
+    stage.workers = static_cast<int>(threads[s].size());
+    stage.frames = stage_frames[s];
+    stage.busy_ms = busy_ms[s];
+    if (elapsed_ms > 0)
+      stage.occupancy = busy_ms[s] / (stage.workers * elapsed_ms);
+  }
+  stats.frames = frames_done;
+  if (elapsed_ms > 0)
+    stats.fps = frames_done * 1000 / elapsed_ms;
+  if (frames_done > 0)
+    stats.latency_ms = latency_ms / frames_done;
+  return stats;
+}
@@ -0,0 +1,135 @@
+#ifndef FACE_PIPELINE_DETECTOR_H_
+#define FACE_PIPELINE_DETECTOR_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <thread>
+#include "mtcnn.h"
+
+namespace face
+{
+// Face detector for a stream of frames run as a pipeline: Pnet, Rnet, Onet
+// and Lnet each have their own group of worker threads, joined by bounded
+// queues, so while Rnet works on frame t Pnet already works on frame t + 1.
+// A frame still goes through the stages one after another, so its latency
+// stays about that of Detect, while frames per second follow the slowest
+// stage. Faces come out in the order frames went in.
+// Push and Pop may be called from different threads, e.g. a capture thread
+// and a consumer thread.
+class PipelineDetector
+{
+public:
+  // Stages of a frame, in order.
+  enum Stage {
+    STAGE_PNET,
+    STAGE_RNET,
+    STAGE_ONET,
+    STAGE_LNET,
+    STAGE_COUNT
+  };
+
+  // Counters of one stage since the first frame.
+  struct StageStats {
+    int workers = 0;
+    size_t frames = 0;
+    double busy_ms = 0;    // time workers ran the stage, summed
+    // busy_ms over workers * elapsed time: near 1 for the stage which limits
+    // the pipeline, low for stages with more workers than they need.
+    double occupancy = 0;
+  };
+  struct Stats {
+    StageStats stages[STAGE_COUNT];
+    size_t frames = 0;      // frames done
+    double fps = 0;         // frames done per second since the first one
+    double latency_ms = 0;  // mean time from Push until faces are done
+  };
+
+  /// @brief Constructor, mtcnn must outlive the detector.
+  /// @param workers: threads of each stage, STAGE_COUNT of them, 1 each if null.
+  /// @param queue_size: frames each queue before a stage may hold.
+  explicit PipelineDetector(Mtcnn & mtcnn, const int* workers = 0, int queue_size = 2);
+  /// @brief Finish frames already pushed and stop workers.
+  ~PipelineDetector();
+  PipelineDetector(const PipelineDetector &) = delete;
+  PipelineDetector & operator=(const PipelineDetector &) = delete;
+
+  /// @brief Queue next frame, its pixels are copied so the caller may reuse
+  /// them at once. Blocks while the pipeline is full.
+  void Push(const ncnn::Mat & frame);
+  void Push(const ImageView & frame);
+  /// @brief Faces of the oldest frame not popped yet, blocks until done.
+  /// @return false once Close was called and every frame was popped.
+  bool Pop(std::vector<BBox> & faces);
+  /// @brief No more frames will be pushed.
+  void Close();
+  /// @brief Counters of stages and frames.
+  Stats stats();
+
+private:
+  typedef std::chrono::steady_clock Clock;
+
+  // A frame on its way through the stages.
+  struct Frame {
+    size_t index;
+    Clock::time_point pushed;
+    std::vector<unsigned char> pixels;  // copy of pixels of a view
+    ncnn::Mat mat;                      // or copy of a float image
+    std::unique_ptr<Mtcnn::_Image> image;
+    std::unique_ptr<Mtcnn::Context> ctx;
+    std::vector<Mtcnn::_BBox> bboxes;
+  };
+
+  // Frames waiting for a stage, Push blocks while it is full.
+  class Queue {
+  public:
+    explicit Queue(size_t capacity) : capacity(capacity) {}
+    void Push(std::unique_ptr<Frame> frame);
+    /// @brief Next frame, null once closed and empty.
+    std::unique_ptr<Frame> Pop();
+    void Close();
+  private:
+    size_t capacity;
+    bool closed = false;
+    std::deque<std::unique_ptr<Frame>> frames;
+    std::mutex frames_mutex;
+    std::condition_variable not_full, not_empty;
+  };
+
+  /// @brief Hand a frame holding a copy of pixels to the first stage.
+  void Start(std::unique_ptr<Frame> frame);
+  /// @brief Worker loop of a stage.
+  void Work(int stage);
+  /// @brief Run stage on frame.
+  void Run(int stage, Frame & frame);
+  /// @brief Keep faces of a frame which went through all stages.
+  void Finish(std::unique_ptr<Frame> frame);
+
+  Mtcnn & mtcnn;
+  std::unique_ptr<Queue> queues[STAGE_COUNT];
+  std::vector<std::thread> threads[STAGE_COUNT];
+  int running[STAGE_COUNT];  // workers not stopped yet, under state_mutex
+
+  // frames pushed, popped and done, faces of frames done but not popped
+  std::mutex state_mutex;
+  std::condition_variable state_cond;
+  size_t capacity;
+  size_t pushed = 0;
+  size_t popped = 0;
+  size_t starting = 0;  // frames pushed but not in the Pnet queue yet
+  bool closed = false;
+  std::map<size_t, std::vector<BBox>> done;
+
+  // counters, under state_mutex
+  Clock::time_point first_push;
+  Clock::time_point last_done;
+  double busy_ms[STAGE_COUNT];
+  size_t stage_frames[STAGE_COUNT];
+  size_t frames_done = 0;
+  double latency_ms = 0;
+};
+
+} // namespace face
+
+#endif // FACE_PIPELINE_DETECTOR_H_
@@ -0,0 +1,221 @@
+#ifndef FACE_SIMD_H_
+#define FACE_SIMD_H_
+
+// Vectors of one instruction set, for kernels written once and built per
+// instruction set, see kernels_impl.h. A file defining FACE_SIMD_AVX512,
+// FACE_SIMD_AVX2 or FACE_SIMD_SSE42 gets those, built with the matching
+// flags, any other file the baseline of the target: SSE2 on x86, NEON on
+// aarch64, plain floats elsewhere. Each set lives in its own namespace, so
+// files built with different flags never share an inline function, and
+// face::simd names the one of the file.
+#if defined(FACE_SIMD_AVX512)
+#define FACE_SIMD_NS simd_avx512
+#include <immintrin.h>
+#elif defined(FACE_SIMD_AVX2)
+#define FACE_SIMD_NS simd_avx2
+#include <immintrin.h>
+#elif defined(FACE_SIMD_SSE42)
+#define FACE_SIMD_NS simd_sse42
+#include <nmmintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FACE_SIMD_SSE2
+#define FACE_SIMD_NS simd_sse2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define FACE_SIMD_NEON
+#define FACE_SIMD_NS simd_neon
+#include <arm_neon.h>
+#else
+#define FACE_SIMD_NS simd_scalar
+#endif
+
+namespace face
+{
+namespace FACE_SIMD_NS
+{
+#if defined(FACE_SIMD_AVX512)
+typedef __m512 Float;
+typedef __m512i Int;
+typedef __mmask16 Mask;
+const int kWidth = 16;
+const char* const kName = "AVX-512";
+inline Float Load(const float* p) { return _mm512_loadu_ps(p); }
+inline void Store(float* p, Float v) { _mm512_storeu_ps(p, v); }
+inline Float Set1(float f) { return _mm512_set1_ps(f); }
+inline Float Zero() { return _mm512_setzero_ps(); }
+inline Float Add(Float a, Float b) { return _mm512_add_ps(a, b); }
+inline Float Sub(Float a, Float b) { return _mm512_sub_ps(a, b); }
+inline Float Mul(Float a, Float b) { return _mm512_mul_ps(a, b); }
+inline Float Div(Float a, Float b) { return _mm512_div_ps(a, b); }
+inline Float MulAdd(Float a, Float b, Float c) { return _mm512_fmadd_ps(a, b, c); }
+inline Float Max(Float a, Float b) { return _mm512_max_ps(a, b); }
+inline Float Min(Float a, Float b) { return _mm512_min_ps(a, b); }
+inline Int LoadInt(const int* p) { return _mm512_loadu_si512(p); }
+inline Int Set1Int(int i) { return _mm512_set1_epi32(i); }
+inline Int AddInt(Int a, Int b) { return _mm512_add_epi32(a, b); }
+inline Int SubInt(Int a, Int b) { return _mm512_sub_epi32(a, b); }
+inline Int MulInt(Int a, Int b) { return _mm512_mullo_epi32(a, b); }
+inline Int MaxInt(Int a, Int b) { return _mm512_max_epi32(a, b); }
+inline Int MinInt(Int a, Int b) { return _mm512_min_epi32(a, b); }
+inline Float ToFloat(Int a) { return _mm512_cvtepi32_ps(a); }
+inline Mask Greater(Float a, Float b) { return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ); }
+inline Mask GreaterEqual(Float a, Float b) { return _mm512_cmp_ps_mask(a, b, _CMP_GE_OQ); }
+inline Mask GreaterInt(Int a, Int b) { return _mm512_cmpgt_epi32_mask(a, b); }
+inline unsigned Bits(Mask m) { return m; }
+#elif defined(FACE_SIMD_AVX2)
+typedef __m256 Float;
+typedef __m256i Int;
+typedef __m256 Mask;
+const int kWidth = 8;
+const char* const kName = "AVX2";
+inline Float Load(const float* p) { return _mm256_loadu_ps(p); }
+inline void Store(float* p, Float v) { _mm256_storeu_ps(p, v); }
+inline Float Set1(float f) { return _mm256_set1_ps(f); }
+inline Float Zero() { return _mm256_setzero_ps(); }
+inline Float Add(Float a, Float b) { return _mm256_add_ps(a, b); }
+inline Float Sub(Float a, Float b) { return _mm256_sub_ps(a, b); }
+inline Float Mul(Float a, Float b) { return _mm256_mul_ps(a, b); }
+inline Float Div(Float a, Float b) { return _mm256_div_ps(a, b); }
+inline Float MulAdd(Float a, Float b, Float c) { return _mm256_fmadd_ps(a, b, c); }
+inline Float Max(Float a, Float b) { return _mm256_max_ps(a, b); }
+inline Float Min(Float a, Float b) { return _mm256_min_ps(a, b); }
+inline Int LoadInt(const int* p) { return _mm256_loadu_si256((const __m256i*)p); }
+inline Int Set1Int(int i) { return _mm256_set1_epi32(i); }
+inline Int AddInt(Int a, Int b) { return _mm256_add_epi32(a, b); }
+inline Int SubInt(Int a, Int b) { return _mm256_sub_epi32(a, b); }
+inline Int MulInt(Int a, Int b) { return _mm256_mullo_epi32(a, b); }
+inline Int MaxInt(Int a, Int b) { return _mm256_max_epi32(a, b); }
+inline Int MinInt(Int a, Int b) { return _mm256_min_epi32(a, b); }
+inline Float ToFloat(Int a) { return _mm256_cvtepi32_ps(a); }
+inline Mask Greater(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+inline Mask GreaterEqual(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+inline Mask GreaterInt(Int a, Int b) { return _mm256_castsi256_ps(_mm256_cmpgt_epi32(a, b)); }
+inline unsigned Bits(Mask m) { return _mm256_movemask_ps(m); }
+#elif defined(FACE_SIMD_SSE42) || defined(FACE_SIMD_SSE2)
+typedef __m128 Float;
+typedef __m128i Int;
+typedef __m128 Mask;
+const int kWidth = 4;
+inline Float Load(const float* p) { return _mm_loadu_ps(p); }
+inline void Store(float* p, Float v) { _mm_storeu_ps(p, v); }
+inline Float Set1(float f) { return _mm_set1_ps(f); }
+inline Float Zero() { return _mm_setzero_ps(); }
+inline Float Add(Float a, Float b) { return _mm_add_ps(a, b); }
+inline Float Sub(Float a, Float b) { return _mm_sub_ps(a, b); }
+inline Float Mul(Float a, Float b) { return _mm_mul_ps(a, b); }
+inline Float Div(Float a, Float b) { return _mm_div_ps(a, b); }
+inline Float MulAdd(Float a, Float b, Float c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+inline Float Max(Float a, Float b) { return _mm_max_ps(a, b); }
+inline Float Min(Float a, Float b) { return _mm_min_ps(a, b); }
+inline Int LoadInt(const int* p) { return _mm_loadu_si128((const __m128i*)p); }
+inline Int Set1Int(int i) { return _mm_set1_epi32(i); }
+inline Int AddInt(Int a, Int b) { return _mm_add_epi32(a, b); }
+inline Int SubInt(Int a, Int b) { return _mm_sub_epi32(a, b); }
+#if defined(FACE_SIMD_SSE42)
+const char* const kName = "SSE4.2";
+inline Int MulInt(Int a, Int b) { return _mm_mullo_epi32(a, b); }
+inline Int MaxInt(Int a, Int b) { return _mm_max_epi32(a, b); }
+inline Int MinInt(Int a, Int b) { return _mm_min_epi32(a, b); }
+#else
+const char* const kName = "SSE2";
+// SSE4.1 min/max/mullo of 32 bit lanes, in SSE2.
+inline Int MulInt(Int a, Int b)
+{
+  __m128i even = _mm_mul_epu32(a, b);
+  __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+  return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+    _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+inline Int MaxInt(Int a, Int b)
+{
+  __m128i gt = _mm_cmpgt_epi32(a, b);
+  return _mm_or_si128(_mm_and_si128(gt, a), _mm_andnot_si128(gt, b));
+}
+
+inline Int MinInt(Int a, Int b)
+{
+  __m128i gt = _mm_cmpgt_epi32(a, b);
+  return _mm_or_si128(_mm_and_si128(gt, b), _mm_andnot_si128(gt, a));
+}
+#endif
+inline Float ToFloat(Int a) { return _mm_cvtepi32_ps(a); }
+inline Mask Greater(Float a, Float b) { return _mm_cmpgt_ps(a, b); }
+inline Mask GreaterEqual(Float a, Float b) { return _mm_cmpge_ps(a, b); }
+inline Mask GreaterInt(Int a, Int b) { return _mm_castsi128_ps(_mm_cmpgt_epi32(a, b)); }
+inline unsigned Bits(Mask m) { return _mm_movemask_ps(m); }
+#elif defined(FACE_SIMD_NEON)
+typedef float32x4_t Float;
+typedef int32x4_t Int;
+typedef uint32x4_t Mask;
+const int kWidth = 4;
+const char* const kName = "NEON";
+inline Float Load(const float* p) { return vld1q_f32(p); }
+inline void Store(float* p, Float v) { vst1q_f32(p, v); }
+inline Float Set1(float f) { return vdupq_n_f32(f); }
+inline Float Zero() { return vdupq_n_f32(0.f); }
+inline Float Add(Float a, Float b) { return vaddq_f32(a, b); }
+inline Float Sub(Float a, Float b) { return vsubq_f32(a, b); }
+inline Float Mul(Float a, Float b) { return vmulq_f32(a, b); }
+inline Float Div(Float a, Float b) { return vdivq_f32(a, b); }
+inline Float MulAdd(Float a, Float b, Float c) { return vfmaq_f32(c, a, b); }
+inline Float Max(Float a, Float b) { return vmaxq_f32(a, b); }
+inline Float Min(Float a, Float b) { return vminq_f32(a, b); }
+inline Int LoadInt(const int* p) { return vld1q_s32(p); }
+inline Int Set1Int(int i) { return vdupq_n_s32(i); }
+inline Int AddInt(Int a, Int b) { return vaddq_s32(a, b); }
+inline Int SubInt(Int a, Int b) { return vsubq_s32(a, b); }
+inline Int MulInt(Int a, Int b) { return vmulq_s32(a, b); }
+inline Int MaxInt(Int a, Int b) { return vmaxq_s32(a, b); }
+inline Int MinInt(Int a, Int b) { return vminq_s32(a, b); }
+inline Float ToFloat(Int a) { return vcvtq_f32_s32(a); }
+inline Mask Greater(Float a, Float b) { return vcgtq_f32(a, b); }
+inline Mask GreaterEqual(Float a, Float b) { return vcgeq_f32(a, b); }
+inline Mask GreaterInt(Int a, Int b) { return vcgtq_s32(a, b); }
+inline unsigned Bits(Mask m)
+{
+  const uint32_t lane_bits[4] = { 1, 2, 4, 8 };
+  return vaddvq_u32(vandq_u32(m, vld1q_u32(lane_bits)));
+}
+#else
+typedef float Float;
+typedef int Int;
+typedef bool Mask;
+const int kWidth = 1;
+const char* const kName = "scalar";
+inline Float Load(const float* p) { return *p; }
+inline void Store(float* p, Float v) { *p = v; }
+inline Float Set1(float f) { return f; }
+inline Float Zero() { return 0.f; }
+inline Float Add(Float a, Float b) { return a + b; }
+inline Float Sub(Float a, Float b) { return a - b; }
+inline Float Mul(Float a, Float b) { return a * b; }
+inline Float Div(Float a, Float b) { return a / b; }
+inline Float MulAdd(Float a, Float b, Float c) { return a * b + c; }
+inline Float Max(Float a, Float b) { return a > b ? a : b; }
+inline Float Min(Float a, Float b) { return a < b ? a : b; }
+inline Int LoadInt(const int* p) { return *p; }
+inline Int Set1Int(int i) { return i; }
+inline Int AddInt(Int a, Int b) { return a + b; }
+inline Int SubInt(Int a, Int b) { return a - b; }
+inline Int MulInt(Int a, Int b) { return a * b; }
+inline Int MaxInt(Int a, Int b) { return a > b ? a : b; }
+inline Int MinInt(Int a, Int b) { return a < b ? a : b; }
+inline Float ToFloat(Int a) { return static_cast<float>(a); }
+inline Mask Greater(Float a, Float b) { return a > b; }
+inline Mask GreaterEqual(Float a, Float b) { return a >= b; }
+inline Mask GreaterInt(Int a, Int b) { return a > b; }
+inline unsigned Bits(Mask m) { return m ? 1u : 0u; }
+#endif
+
+/// @brief PReLU of v: v if positive, else v * slope.
+inline Float PReLU(Float v, Float slope)
+{
+  return MulAdd(Min(v, Zero()), slope, Max(v, Zero()));
+}
+} // namespace FACE_SIMD_NS
+
+namespace simd = FACE_SIMD_NS;
+} // namespace face
+
+#endif // FACE_SIMD_H_
@@ -0,0 +1,93 @@
+#include <algorithm>  // std::min
+#include <atomic>
+#include <memory>
+
+#include "thread_pool.h"
+using namespace std;
+using namespace face;
+
+ThreadPool::ThreadPool(int num_threads) :
+  num_threads(std::max<int>(num_threads, 1))
+{
+  for (int i = 1; i < this->num_threads; i++)
+    workers.emplace_back(&ThreadPool::Work, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    lock_guard<mutex> lock(tasks_mutex);
+    stop = true;
+  }
+  tasks_cond.notify_all();
+  for (auto & worker : workers)
+    worker.join();
+}
+
+void ThreadPool::Work()
+{
+  for (;;) {
+    function<void()> task;
+    {
+      unique_lock<mutex> lock(tasks_mutex);
+      tasks_cond.wait(lock, [this]() { return stop || !tasks.empty(); });
+      if (stop && tasks.empty())
+        return;
+      task = std::move(tasks.front());
+      tasks.pop();
+    }
+    task();
+  }
+}
+
+void ThreadPool::ParallelFor(int n, const function<void(int)> & func)
+{
+  if (n <= 0)
+    return;
+  if (workers.empty() || n == 1) {
+    for (int i = 0; i < n; i++)
+      func(i);
+    return;
+  }
+
+  // Indices are handed out one by one. A helper which starts after all
+  // indices are taken returns at once, so the caller only waits for work
+  // actually running, never for helpers still queued behind other calls.
+  struct Job {
+    const function<void(int)> * func;
+    int n;
+    atomic<int> next;
+    int done;
+    mutex done_mutex;
+    condition_variable done_cond;
+  };
+  shared_ptr<Job> job = make_shared<Job>();
+  job->func = &func;
+  job->n = n;
+  job->next = 0;
+  job->done = 0;
+  auto run = [](Job & job) {
+    int finished = 0;
+    for (int i = job.next++; i < job.n; i = job.next++) {
+      (*job.func)(i);
+      finished++;
+    }
+    if (finished > 0) {
+      lock_guard<mutex> lock(job.done_mutex);
+      job.done += finished;
+      if (job.done == job.n)
+        job.done_cond.notify_all();
+    }
+  };
+
+  int helpers = std::min<int>(n, num_threads) - 1;
+  {
+    lock_guard<mutex> lock(tasks_mutex);
+    for (int i = 0; i < helpers; i++)
+      tasks.push([job, run]() { run(*job); });
+  }
+  tasks_cond.notify_all();
+  run(*job);
+  unique_lock<mutex> lock(job->done_mutex);
+  job->done_cond.wait(lock, [&job]() { return job->done == job->n; });
+}
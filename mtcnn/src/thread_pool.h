@@ -0,0 +1,41 @@
+#ifndef FACE_THREAD_POOL_H_
+#define FACE_THREAD_POOL_H_
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace face
+{
+// Fixed set of worker threads shared by all calls of a detector.
+class ThreadPool
+{
+public:
+  /// @brief Start num_threads - 1 workers, the calling thread is the last one.
+  explicit ThreadPool(int num_threads);
+  ~ThreadPool();
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool & operator=(const ThreadPool &) = delete;
+
+  int size() const { return num_threads; }
+  /// @brief Run func(0) .. func(n-1) on workers and calling thread,
+  /// return when all have finished. May be called from many threads at once.
+  void ParallelFor(int n, const std::function<void(int)> & func);
+
+private:
+  void Work();
+
+  int num_threads;
+  std::vector<std::thread> workers;
+  std::queue<std::function<void()>> tasks;
+  std::mutex tasks_mutex;
+  std::condition_variable tasks_cond;
+  bool stop = false;
+};
+
+} // namespace face
+
+#endif // FACE_THREAD_POOL_H_
@@ -0,0 +1,61 @@
+#include <algorithm>  // std::max
+#include <cmath>      // round
+
+#include "video_detector.h"
+using namespace std;
+using namespace face;
+
+VideoDetector::VideoDetector(Mtcnn & mtcnn) :
+  mtcnn(mtcnn)
+{
+}
+
+vector<BBox> VideoDetector::Detect(const ncnn::Mat & frame)
+{
+  return Track(frame);
+}
+
+vector<BBox> VideoDetector::Detect(const ImageView & frame)
+{
+  return Track(frame);
+}
+
+template<typename Frame>
+vector<BBox> VideoDetector::Track(const Frame & frame)
+{
+  if (!faces.empty() && frames < detect_interval) {
+    vector<BBox> tracked = mtcnn.Refine(frame, Proposals());
+    // every face is found again
+    if (tracked.size() >= faces.size()) {
+      faces = tracked;
+      frames++;
+      return faces;
+    }
+  }
+  faces = mtcnn.Detect(frame);
+  frames = 1;
+  return faces;
+}
+
+void VideoDetector::Reset()
+{
+  faces.clear();
+  frames = 0;
+}
+
+vector<BBox> VideoDetector::Proposals() const
+{
+  vector<BBox> proposals;
+  for (const BBox & face : faces) {
+    float size = std::max<int>(face.x2 - face.x1, face.y2 - face.y1) * (1 + 2 * margin);
+    float cx = (face.x1 + face.x2) * 0.5f;
+    float cy = (face.y1 + face.y2) * 0.5f;
+    BBox bbox;
+    bbox.x1 = static_cast<int>(round(cx - size * 0.5f));
+    bbox.y1 = static_cast<int>(round(cy - size * 0.5f));
+    bbox.x2 = bbox.x1 + static_cast<int>(size);
+    bbox.y2 = bbox.y1 + static_cast<int>(size);
+    proposals.push_back(bbox);
+  }
+  return proposals;
+}
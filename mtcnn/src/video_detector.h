@@ -0,0 +1,44 @@
+#ifndef FACE_VIDEO_DETECTOR_H_
+#define FACE_VIDEO_DETECTOR_H_
+
+#include "mtcnn.h"
+
+namespace face
+{
+// Face detector for frames of one stream.
+// Every detect_interval frames it runs the full Mtcnn::Detect. In between,
+// faces of the previous frame, expanded by margin, are the only proposals
+// of R/O/Lnet and Pnet is skipped. When a face is lost, the full detect
+// runs at once, and so it does on every frame without faces. Streams may
+// share one Mtcnn, but each needs its own VideoDetector.
+class VideoDetector
+{
+public:
+  /// @brief Constructor, mtcnn must outlive the detector.
+  explicit VideoDetector(Mtcnn & mtcnn);
+  /// @brief Detect faces in the next frame of stream.
+  std::vector<BBox> Detect(const ncnn::Mat & frame);
+  std::vector<BBox> Detect(const ImageView & frame);
+  /// @brief Forget faces, the next frame runs the full detect.
+  void Reset();
+
+  // default settings
+  int detect_interval = 10;
+  // each side of a face is moved out by margin * size of face.
+  float margin = 0.2f;
+
+private:
+  /// @brief Track faces into frame, or detect them again.
+  template<typename Frame>
+  std::vector<BBox> Track(const Frame & frame);
+  /// @brief Expand faces by margin into square proposals.
+  std::vector<BBox> Proposals() const;
+
+  Mtcnn & mtcnn;
+  std::vector<BBox> faces;
+  int frames = 0;  // frames since last full detect
+};
+
+} // namespace face
+
+#endif // FACE_VIDEO_DETECTOR_H_
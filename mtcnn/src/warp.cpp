@@ -0,0 +1,298 @@
+#include <algorithm>  // std::fill, std::swap, std::min, std::max
+#include <climits>    // INT_MIN
+#include <cmath>      // floor
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define WARP_SSE2 1
+#include <emmintrin.h>
+#elif __ARM_NEON
+#define WARP_NEON 1
+#include <arm_neon.h>
+#endif
+
+#include "kernels.h"
+#include "warp.h"
+using namespace std;
+
+namespace
+{
+// Taps of one axis, placed like ncnn resize_bilinear places them on the
+// region, then moved into image: positions are -1 outside image or region.
+void LinearTaps(int start, int src_len, int image_len, int dst_len,
+  int dst_begin, int dst_count, int* pos0, int* pos1, float* coef0, float* coef1)
+{
+  double scale = (double)src_len / dst_len;
+  for (int d = 0; d < dst_count; d++) {
+    float f = (float)((dst_begin + d + 0.5) * scale - 0.5);
+    int s = static_cast<int>(floor(f));
+    f -= s;
+    if (s < 0) {
+      s = 0;
+      f = 0.f;
+    }
+    if (s >= src_len - 1) {
+      s = src_len - 2;
+      f = 1.f;
+    }
+    // region of a single pixel
+    if (s < 0) {
+      s = 0;
+      f = 0.f;
+    }
+    int p0 = start + s;
+    int p1 = p0 + 1;
+    pos0[d] = p0 >= 0 && p0 < image_len ? p0 : -1;
+    pos1[d] = s + 1 < src_len && p1 >= 0 && p1 < image_len ? p1 : -1;
+    coef0[d] = 1.f - f;
+    coef1[d] = f;
+  }
+}
+
+template<typename T>
+inline float Tap(const T* row, int step, int x)
+{
+  return x >= 0 ? static_cast<float>(row[x * step]) : 0.f;
+}
+
+// One resized row of a channel, row is null outside image. Taps are
+// gathered one by one, so wider vectors than the baseline gain nothing.
+template<typename T>
+void HorizontalPass(const T* row, int step, const int* xs0, const int* xs1,
+  const float* a0, const float* a1, int w, float* out)
+{
+  if (!row) {
+    std::fill(out, out + w, 0.f);
+    return;
+  }
+  int dx = 0;
+#if WARP_SSE2
+  for (; dx + 3 < w; dx += 4) {
+    __m128 v0 = _mm_setr_ps(Tap(row, step, xs0[dx]), Tap(row, step, xs0[dx + 1]),
+      Tap(row, step, xs0[dx + 2]), Tap(row, step, xs0[dx + 3]));
+    __m128 v1 = _mm_setr_ps(Tap(row, step, xs1[dx]), Tap(row, step, xs1[dx + 1]),
+      Tap(row, step, xs1[dx + 2]), Tap(row, step, xs1[dx + 3]));
+    __m128 r = _mm_add_ps(_mm_mul_ps(v0, _mm_loadu_ps(a0 + dx)),
+      _mm_mul_ps(v1, _mm_loadu_ps(a1 + dx)));
+    _mm_storeu_ps(out + dx, r);
+  }
+#elif WARP_NEON
+  for (; dx + 3 < w; dx += 4) {
+    float t0[4] = { Tap(row, step, xs0[dx]), Tap(row, step, xs0[dx + 1]),
+      Tap(row, step, xs0[dx + 2]), Tap(row, step, xs0[dx + 3]) };
+    float t1[4] = { Tap(row, step, xs1[dx]), Tap(row, step, xs1[dx + 1]),
+      Tap(row, step, xs1[dx + 2]), Tap(row, step, xs1[dx + 3]) };
+    float32x4_t r = vaddq_f32(vmulq_f32(vld1q_f32(t0), vld1q_f32(a0 + dx)),
+      vmulq_f32(vld1q_f32(t1), vld1q_f32(a1 + dx)));
+    vst1q_f32(out + dx, r);
+  }
+#endif
+  for (; dx < w; dx++)
+    out[dx] = Tap(row, step, xs0[dx]) * a0[dx] + Tap(row, step, xs1[dx]) * a1[dx];
+}
+
+// One row of a YUV 4:2:0 image, chroma of pixel x at u/v[(x / 2) * uv_step].
+struct YUVRow {
+  const unsigned char* y;
+  const unsigned char* u;
+  const unsigned char* v;
+  int uv_step;
+};
+
+// BGR of pixel x, as ncnn yuv420sp2rgb computes it.
+inline void YUVPixel(const YUVRow & row, int x, float* bgr)
+{
+  int v = row.v[(x >> 1) * row.uv_step] - 128;
+  int u = row.u[(x >> 1) * row.uv_step] - 128;
+  int y = row.y[x] << 6;
+  bgr[0] = static_cast<float>(std::min<int>(std::max<int>((y + 113 * u) >> 6, 0), 255));
+  bgr[1] = static_cast<float>(std::min<int>(std::max<int>((y - 46 * v - 22 * u) >> 6, 0), 255));
+  bgr[2] = static_cast<float>(std::min<int>(std::max<int>((y + 90 * v) >> 6, 0), 255));
+}
+
+inline void YUVTap(const YUVRow & row, int x, float* bgr)
+{
+  if (x >= 0)
+    YUVPixel(row, x, bgr);
+  else
+    bgr[0] = bgr[1] = bgr[2] = 0.f;
+}
+
+// One resized row of all three channels, row.y is null outside image.
+void HorizontalPassYUV(const YUVRow & row, const int* xs0, const int* xs1,
+  const float* a0, const float* a1, int w, float* out)
+{
+  if (!row.y) {
+    std::fill(out, out + 3 * w, 0.f);
+    return;
+  }
+  int dx = 0;
+#if WARP_SSE2 || WARP_NEON
+  for (; dx + 3 < w; dx += 4) {
+    // taps of 4 outputs, transposed to channel major
+    float t0[3][4], t1[3][4];
+    for (int k = 0; k < 4; k++) {
+      float bgr0[3], bgr1[3];
+      YUVTap(row, xs0[dx + k], bgr0);
+      YUVTap(row, xs1[dx + k], bgr1);
+      for (int q = 0; q < 3; q++) {
+        t0[q][k] = bgr0[q];
+        t1[q][k] = bgr1[q];
+      }
+    }
+    for (int q = 0; q < 3; q++) {
+#if WARP_SSE2
+      __m128 r = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(t0[q]), _mm_loadu_ps(a0 + dx)),
+        _mm_mul_ps(_mm_loadu_ps(t1[q]), _mm_loadu_ps(a1 + dx)));
+      _mm_storeu_ps(out + q * w + dx, r);
+#else
+      float32x4_t r = vaddq_f32(vmulq_f32(vld1q_f32(t0[q]), vld1q_f32(a0 + dx)),
+        vmulq_f32(vld1q_f32(t1[q]), vld1q_f32(a1 + dx)));
+      vst1q_f32(out + q * w + dx, r);
+#endif
+    }
+  }
+#endif
+  for (; dx < w; dx++) {
+    float bgr0[3], bgr1[3];
+    YUVTap(row, xs0[dx], bgr0);
+    YUVTap(row, xs1[dx], bgr1);
+    for (int q = 0; q < 3; q++)
+      out[q * w + dx] = bgr0[q] * a0[dx] + bgr1[q] * a1[dx];
+  }
+}
+
+// Two source rows of all channels are kept, and reused by the next output
+// row when it reads the same ones. horizontal(y, ..., rows) fills channel q
+// of image row y into rows + q * w. Only window of the w x h output is made.
+template<typename Horizontal>
+void Warp(int channels, int width, int height, int x1, int y1, int x2, int y2,
+  int dst_w, int dst_h, const face::WarpWindow & window, float* dst, size_t cstep,
+  ncnn::Allocator* allocator, Horizontal horizontal)
+{
+  int w = window.w, h = window.h;
+  if (w <= 0 || h <= 0)
+    return;
+  if (x2 <= x1 || y2 <= y1) {
+    for (int q = 0; q < channels; q++)
+      std::fill(dst + q * cstep, dst + q * cstep + w * h, 0.f);
+    return;
+  }
+  ncnn::Mat buf(4 * w + 4 * h + 2 * channels * w, 4u, allocator);
+  int* xs0 = reinterpret_cast<int*>(buf.data);
+  int* xs1 = xs0 + w;
+  float* a0 = reinterpret_cast<float*>(xs1 + w);
+  float* a1 = a0 + w;
+  int* ys0 = reinterpret_cast<int*>(a1 + w);
+  int* ys1 = ys0 + h;
+  float* b0 = reinterpret_cast<float*>(ys1 + h);
+  float* b1 = b0 + h;
+  float* rows0 = b1 + h;
+  float* rows1 = rows0 + channels * w;
+  LinearTaps(x1, x2 - x1, width, dst_w, window.x, w, xs0, xs1, a0, a1);
+  LinearTaps(y1, y2 - y1, height, dst_h, window.y, h, ys0, ys1, b0, b1);
+
+  const face::Kernels & kernels = face::GetKernels();
+  int prev0 = INT_MIN, prev1 = INT_MIN;
+  for (int dy = 0; dy < h; dy++) {
+    int sy0 = ys0[dy], sy1 = ys1[dy];
+    if (sy0 != prev0 || sy1 != prev1) {
+      if (sy0 == prev1) {
+        std::swap(rows0, rows1);
+      }
+      else {
+        horizontal(sy0, xs0, xs1, a0, a1, w, rows0);
+      }
+      horizontal(sy1, xs0, xs1, a0, a1, w, rows1);
+      prev0 = sy0;
+      prev1 = sy1;
+    }
+    for (int q = 0; q < channels; q++)
+      kernels.lerp_rows(rows0 + q * w, rows1 + q * w, b0[dy], b1[dy], w, dst + q * cstep + dy * w);
+  }
+}
+
+} // namespace
+
+namespace face
+{
+void WarpRoi(const ncnn::Mat & image, int x1, int y1, int x2, int y2,
+  int w, int h, float* dst, size_t cstep, ncnn::Allocator* allocator)
+{
+  WarpWindow window = { 0, 0, w, h };
+  WarpRoi(image, x1, y1, x2, y2, w, h, window, dst, cstep, allocator);
+}
+
+void WarpRoi(const ncnn::Mat & image, int x1, int y1, int x2, int y2,
+  int w, int h, const WarpWindow & window, float* dst, size_t cstep, ncnn::Allocator* allocator)
+{
+  Warp(image.c, image.w, image.h, x1, y1, x2, y2, w, h, window, dst, cstep, allocator,
+    [&image](int y, const int* xs0, const int* xs1, const float* a0, const float* a1,
+      int w, float* rows) {
+      for (int q = 0; q < image.c; q++) {
+        const float* row = y >= 0 ? (const float*)image.data + image.cstep * q + image.w * y : 0;
+        HorizontalPass(row, 1, xs0, xs1, a0, a1, w, rows + q * w);
+      }
+    });
+}
+
+void WarpRoi(const unsigned char* pixels, int width, int height, int stride,
+  int step, const int* offsets, int channels, int x1, int y1, int x2, int y2,
+  int w, int h, float* dst, size_t cstep, ncnn::Allocator* allocator)
+{
+  WarpWindow window = { 0, 0, w, h };
+  WarpRoi(pixels, width, height, stride, step, offsets, channels,
+    x1, y1, x2, y2, w, h, window, dst, cstep, allocator);
+}
+
+void WarpRoi(const unsigned char* pixels, int width, int height, int stride,
+  int step, const int* offsets, int channels, int x1, int y1, int x2, int y2,
+  int w, int h, const WarpWindow & window, float* dst, size_t cstep, ncnn::Allocator* allocator)
+{
+  Warp(channels, width, height, x1, y1, x2, y2, w, h, window, dst, cstep, allocator,
+    [=](int y, const int* xs0, const int* xs1, const float* a0, const float* a1,
+      int w, float* rows) {
+      for (int q = 0; q < channels; q++) {
+        const unsigned char* row = y >= 0 ? pixels + stride * y + offsets[q] : 0;
+        HorizontalPass(row, step, xs0, xs1, a0, a1, w, rows + q * w);
+      }
+    });
+}
+
+void WarpRoiYUV420(const unsigned char* y, const unsigned char* u, const unsigned char* v,
+  int width, int height, int stride, int uv_stride, int uv_step,
+  int x1, int y1, int x2, int y2,
+  int w, int h, float* dst, size_t cstep, ncnn::Allocator* allocator)
+{
+  WarpWindow window = { 0, 0, w, h };
+  WarpRoiYUV420(y, u, v, width, height, stride, uv_stride, uv_step,
+    x1, y1, x2, y2, w, h, window, dst, cstep, allocator);
+}
+
+void WarpRoiYUV420(const unsigned char* y, const unsigned char* u, const unsigned char* v,
+  int width, int height, int stride, int uv_stride, int uv_step,
+  int x1, int y1, int x2, int y2,
+  int w, int h, const WarpWindow & window, float* dst, size_t cstep, ncnn::Allocator* allocator)
+{
+  Warp(3, width, height, x1, y1, x2, y2, w, h, window, dst, cstep, allocator,
+    [=](int sy, const int* xs0, const int* xs1, const float* a0, const float* a1,
+      int w, float* rows) {
+      YUVRow row = { 0, 0, 0, uv_step };
+      if (sy >= 0) {
+        row.y = y + stride * sy;
+        row.u = u + uv_stride * (sy / 2);
+        row.v = v + uv_stride * (sy / 2);
+      }
+      HorizontalPassYUV(row, xs0, xs1, a0, a1, w, rows);
+    });
+}
+
+void WarpRoi(const ncnn::Mat & image, int x1, int y1, int x2, int y2,
+  ncnn::Mat & dst, int w, int h, ncnn::Allocator* allocator)
+{
+  dst.create(w, h, image.c, 4u, allocator);
+  if (dst.empty())
+    return;
+  WarpRoi(image, x1, y1, x2, y2, w, h, (float*)dst.data, dst.cstep, allocator);
+}
+
+} // namespace face
@@ -0,0 +1,54 @@
+#ifndef FACE_WARP_H_
+#define FACE_WARP_H_
+
+// ncnn
+#include "mat.h"
+
+namespace face
+{
+// Crop, zero padding and bilinear resize of a region in one pass.
+// Region [x1, x2) x [y1, y2) may reach outside the image, samples there
+// are 0. Output equals resize_bilinear of the zero padded crop, without
+// building the crop or its padding.
+// Overloads with a window make only that part of the w x h output, with
+// the same values as the whole one, rows window.w floats apart.
+
+// Part [x, x + w) x [y, y + h) of a warp output.
+struct WarpWindow {
+  int x, y, w, h;
+};
+
+/// @brief Warp region of a planar float image to w x h,
+/// channel q is written at dst + q * cstep, rows w floats apart.
+void WarpRoi(const ncnn::Mat & image, int x1, int y1, int x2, int y2,
+  int w, int h, float* dst, size_t cstep, ncnn::Allocator* allocator = 0);
+void WarpRoi(const ncnn::Mat & image, int x1, int y1, int x2, int y2,
+  int w, int h, const WarpWindow & window, float* dst, size_t cstep, ncnn::Allocator* allocator = 0);
+/// @brief Warp region of interleaved u8 pixels to planar float w x h.
+/// Pixels are step bytes apart, and output channel q reads the byte at
+/// offsets[q] of each pixel, which also reorders or repeats channels.
+void WarpRoi(const unsigned char* pixels, int width, int height, int stride,
+  int step, const int* offsets, int channels, int x1, int y1, int x2, int y2,
+  int w, int h, float* dst, size_t cstep, ncnn::Allocator* allocator = 0);
+void WarpRoi(const unsigned char* pixels, int width, int height, int stride,
+  int step, const int* offsets, int channels, int x1, int y1, int x2, int y2,
+  int w, int h, const WarpWindow & window, float* dst, size_t cstep, ncnn::Allocator* allocator = 0);
+/// @brief Warp region of a YUV 4:2:0 image to planar float BGR w x h.
+/// Y rows are stride bytes apart, U/V rows uv_stride bytes, and chroma
+/// samples uv_step bytes: 2 for NV21/NV12, 1 for I420. Pixels are converted
+/// with the integer BT.601 formula of ncnn yuv420sp2rgb while sampling.
+void WarpRoiYUV420(const unsigned char* y, const unsigned char* u, const unsigned char* v,
+  int width, int height, int stride, int uv_stride, int uv_step,
+  int x1, int y1, int x2, int y2,
+  int w, int h, float* dst, size_t cstep, ncnn::Allocator* allocator = 0);
+void WarpRoiYUV420(const unsigned char* y, const unsigned char* u, const unsigned char* v,
+  int width, int height, int stride, int uv_stride, int uv_step,
+  int x1, int y1, int x2, int y2,
+  int w, int h, const WarpWindow & window, float* dst, size_t cstep, ncnn::Allocator* allocator = 0);
+/// @brief Warp region of a planar float image into dst of w x h x image.c.
+void WarpRoi(const ncnn::Mat & image, int x1, int y1, int x2, int y2,
+  ncnn::Mat & dst, int w, int h, ncnn::Allocator* allocator = 0);
+
+} // namespace face
+
+#endif // FACE_WARP_H_